@@ -1,439 +1,5267 @@
+#define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sched.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#if defined __x86_64__ || defined __i386__
+#include <x86intrin.h>
+#endif
+#include "malloc_arena.h"
+#include "malloc_batch.h"
+#include "malloc_stats.h"
+#include "malloc_trace.h"
+
+/*
+ * An in use _block costs BLOCK_OVERHEAD bytes on top of its payload: the
+ * size word.  Its prev_size sits in the last word of the previous
+ * _block's payload and only counts while that _block is free.  A free
+ * _block keeps its list links in its payload, so it needs BLOCK_MIN
+ * bytes of payload.  HEADER_SIZE is the distance from a _block to its
+ * payload.
+ */
+#define BLOCK_OVERHEAD    sizeof(size_t)
+#define BLOCK_MIN         (3 * sizeof(void *))
+#define HEADER_SIZE       offsetof(struct _block, next_free)
+
+/* Flags in the low bits of size */
+#define BLOCK_FREE        ((size_t)1)   /* _block is free                    */
+#define BLOCK_PREV_INUSE  ((size_t)2)   /* Previous _block in use, or none   */
+#define BLOCK_MMAPPED     ((size_t)4)   /* _block is its own mmap() region   */
+#define BLOCK_FLAGS       ((size_t)7)
+
+#define BLOCK_SIZE(b)     ((b)->size & ~BLOCK_FLAGS)
+#define BLOCK_IS_FREE(b)  (((b)->size & BLOCK_FREE) != 0)
+#define BLOCK_DATA(b)     ((void *)&(b)->next_free)
+#define BLOCK_HEADER(ptr) ((struct _block *)((char *)(ptr) - HEADER_SIZE))
+#define BLOCK_NEXT(b)     ((struct _block *)((char *)(b) + BLOCK_OVERHEAD + BLOCK_SIZE(b)))
+#define BLOCK_PREV(b)     ((struct _block *)((char *)(b) - BLOCK_OVERHEAD - (b)->prev_size))
+#define BLOCK_MAPPING(b)  ((b)->prev_size + HEADER_SIZE + BLOCK_SIZE(b)) /* Mapped only */
+
+/*
+ * Every pointer handed out is ALIGNMENT aligned, enough for any type
+ * (max_align_t) and for SSE loads.  _blocks start aligned, so their data
+ * does too, and their size plus BLOCK_OVERHEAD is a multiple of
+ * ALIGNMENT so the next _block starts aligned as well.
+ *
+ * Size classes for the segregated free lists.  The first NUM_SMALL_CLASSES
+ * classes are exact: each one holds _blocks of a single size, so any _block
+ * found there satisfies the request.  The remaining classes each cover a
+ * power of two range above SMALL_LIMIT, and the last one is unbounded.
+ */
+#define ALIGNMENT         16
+#define NUM_SMALL_CLASSES 32
+#define NUM_CLASSES       64
+#define SMALL_LIMIT       (NUM_SMALL_CLASSES * ALIGNMENT)
+#define ALIGN(s)          (((s) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+#define SMALL_CLASS(i)    ((size_t)(i) * ALIGNMENT)
+#define LARGE_CLASS(i)    ((size_t)SMALL_LIMIT << (i))
+#define CLASSES_4(C, i)   C(i), C((i) + 1), C((i) + 2), C((i) + 3)
+#define CLASSES_16(C, i)  CLASSES_4(C, i), CLASSES_4(C, (i) + 4), \
+                          CLASSES_4(C, (i) + 8), CLASSES_4(C, (i) + 12)
+
+/*
+ * Best and worst fit keep the free _blocks above SMALL_LIMIT in a size
+ * tree instead of the power of two classes: an AVL tree ordered by size
+ * and then address, so both policies find their _block in O(log n) and
+ * ties always go to the lowest address.
+ */
+
+/*
+ * The adaptive policy reviews each arena every ADAPT_WINDOW lookups.  It
+ * leaves next fit when next fit visited more than ADAPT_SEARCH _blocks
+ * per lookup or more than ADAPT_FRAG_HIGH percent of the free bytes lie
+ * outside the largest free _block, and returns once that share is back
+ * under ADAPT_FRAG_LOW percent.
+ */
+#define ADAPT_WINDOW      1024
+#define ADAPT_SEARCH      8
+#define ADAPT_FRAG_HIGH   50
+#define ADAPT_FRAG_LOW    20
+
+/* Largest _block size held by each class */
+static const size_t class_size[NUM_CLASSES] =
+{
+   CLASSES_16(SMALL_CLASS, 1), CLASSES_16(SMALL_CLASS, 17),
+   CLASSES_16(LARGE_CLASS, 1), CLASSES_4(LARGE_CLASS, 17),
+   CLASSES_4(LARGE_CLASS, 21), CLASSES_4(LARGE_CLASS, 25),
+   LARGE_CLASS(29), LARGE_CLASS(30), LARGE_CLASS(31), SIZE_MAX
+};
+
+/*
+ * Arenas.  The main arena grows with sbrk(), unless MALLOC_PAGES=mmap or
+ * huge pages (see below) say otherwise.  Every other arena grows inside
+ * heaps: HEAP_MAX_SIZE regions reserved with mmap() at an address
+ * aligned to their size, so the heap holding a _block is found by
+ * masking its address.  Pages of a heap are committed as it grows.
+ */
+#define MAX_ARENAS        64
+#define HEAP_MAX_SIZE     (64UL * 1024 * 1024)
+#define HEAP_OF(b)        ((struct _heap *)((uintptr_t)(b) & ~(HEAP_MAX_SIZE - 1)))
+
+/*
+ * Huge pages.  With MALLOC_HUGEPAGES=thp the main arena grows in heaps
+ * like the others instead of with sbrk(), so all heap memory lies in
+ * HEAP_MAX_SIZE aligned regions, and every heap is advised MADV_HUGEPAGE.
+ * With MALLOC_HUGEPAGES=hugetlb heaps come from the preconfigured pool
+ * through MAP_HUGETLB, and fall back to THP when the pool runs short.
+ * Huge page heaps commit, trim and purge in whole HUGE_PAGE_SIZE steps
+ * so no huge page is ever split.
+ */
+#define HUGE_PAGE_SIZE    (2UL * 1024 * 1024)
+
+enum { HUGE_OFF, HUGE_THP, HUGE_TLB };
+
+static int huge_pages = HUGE_OFF;
+
+/*
+ * Requests of at least mmap_threshold bytes get their own anonymous
+ * mapping instead of a _block in an arena.  Unless the threshold was set
+ * through MALLOC_MMAP_THRESHOLD or mallopt(), freeing a mapped _block
+ * raises it to that _block's size, up to MMAP_THRESHOLD_MAX, the way
+ * glibc does: buffers of that size are reused often enough to belong in
+ * the heap.
+ */
+#define MMAP_THRESHOLD_DEFAULT (128 * 1024)
+#define MMAP_THRESHOLD_MAX     (32 * 1024 * 1024)
+
+static size_t mmap_threshold       = MMAP_THRESHOLD_DEFAULT;
+static bool   mmap_threshold_fixed = false;
+
+/*
+ * A free _block of at least trim_threshold bytes at the end of an arena
+ * is given back to the OS.  The dynamic mmap threshold keeps it at twice
+ * the mmap threshold unless it was set through MALLOC_TRIM_THRESHOLD or
+ * mallopt().
+ */
+#define TRIM_THRESHOLD_DEFAULT (128 * 1024)
+
+static size_t trim_threshold       = TRIM_THRESHOLD_DEFAULT;
+static bool   trim_threshold_fixed = false;
+
+/*
+ * Heaps ask the OS for memory in steps that double with every call, from
+ * grow_min, which MALLOC_GROW_STEP sets, up to GROW_STEP_MAX.  What a
+ * step holds beyond the request stays past the fence as the wilderness,
+ * and later requests that miss the free lists are carved from it without
+ * a system call.  The wilderness is no free _block, so the placement
+ * policies never see it.  A trim keeps grow_min bytes of it and starts
+ * the steps over.
+ */
+#define GROW_STEP_DEFAULT      (128 * 1024)
+#define GROW_STEP_MAX          (16 * 1024 * 1024)
+
+static size_t grow_min = GROW_STEP_DEFAULT;
+
+/*
+ * Slabs.  With slabs on, requests up to SMALL_LIMIT are carved out of
+ * SLAB_SIZE slabs that each hold objects of one class, with no header per
+ * object.  A bitmap in the slab header marks the free slots.  All slabs
+ * live in one region reserved on first use, so a range check tells slab
+ * objects from _blocks and masking the address finds the slab.  The four
+ * per policy libraries exist to study placement, so they keep every
+ * request in the heap unless MALLOC_SLABS says otherwise.
+ */
+#define SLAB_SIZE         4096
+#define SLAB_REGION_SIZE  (1UL << 30)
+#define SLAB_COMMIT       (64 * 1024)
+#define SLAB_MIN_SLOT     sizeof(void *)
+#define SLAB_WORDS        ((SLAB_SIZE / SLAB_MIN_SLOT + 63) / 64)
+#define SLAB_OF(p)        ((struct _slab *)((uintptr_t)(p) & ~(uintptr_t)(SLAB_SIZE - 1)))
+#define SLAB_DATA(s)      ((char *)(s) + ((sizeof(struct _slab) + 15) & ~15))
+
+#if defined FIT || defined NEXT || defined BEST || defined WORST
+static bool use_slabs = false;
+#else
+static bool use_slabs = true;
+#endif
+
+/*
+ * The statistics are printed at exit by the four per policy libraries,
+ * which exist to study them, and by libmalloc.so only when asked to
+ * through MALLOC_STATS.
+ */
+#if defined FIT || defined NEXT || defined BEST || defined WORST
+static bool print_stats = true;
+#else
+static bool print_stats = false;
+#endif
+
+/*
+ * Latency histograms.  With MALLOC_LATENCY set, every call to malloc,
+ * free, calloc and realloc is timed with the TSC and counted twice: once
+ * under its size and once under the path it took.  Buckets are HDR style:
+ * a power of two split into LAT_SUB linear steps, so a bucket is never
+ * wider than 1/LAT_SUB of the values in it.
+ */
+#define LAT_SUB_BITS      3
+#define LAT_SUB           (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS       ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+#define LAT_SIZES         24            /* 16 bytes up to 64 MB and above */
+
+enum { LAT_MALLOC, LAT_FREE, LAT_CALLOC, LAT_REALLOC, LAT_OPS };
+
+enum
+{
+   PATH_OTHER,        /* Failed or trivial calls                     */
+   PATH_CACHE,        /* Served by the thread cache                  */
+   PATH_SLAB,         /* Slab slot taken or given back               */
+   PATH_REUSE,        /* Free _block used as it was                  */
+   PATH_SPLIT,        /* Free _block split                           */
+   PATH_GROW,         /* Heap grown                                  */
+   PATH_MMAP,         /* Own mapping created, resized or unmapped    */
+   PATH_REMOTE,       /* Pushed onto another arena's remote list     */
+   PATH_COALESCE,     /* _block merged into the free lists           */
+   PATH_INPLACE,      /* realloc kept the _block                     */
+   PATH_MOVE,         /* realloc moved the data                      */
+   LAT_PATHS
+};
+
+static bool latency_on = false;
+static __thread unsigned char lat_path __attribute__((tls_model("initial-exec")));
+
+static uint64_t lat_size[LAT_OPS][LAT_SIZES][LAT_BUCKETS];
+static uint64_t lat_paths[LAT_OPS][LAT_PATHS][LAT_BUCKETS];
+static uint64_t lat_start_ticks;
+static uint64_t lat_start_ns;
+
+/*
+ * Allocation trace.  With MALLOC_TRACE set, the entry points log every
+ * call into a ring of events in a shared mapping of the trace file, see
+ * malloc_trace.h, so logging never allocates and the log survives a
+ * crash.  MALLOC_TRACE_SIZE is the size of the ring in bytes.
+ */
+#define TRACE_SIZE        (256 * 1024 * 1024)
+
+static bool trace_on = false;
+static struct malloc_trace_header *trace_header = NULL;
+static struct malloc_trace_event  *trace_events = NULL;
+static uint64_t trace_start_ns;
+static __thread uint32_t trace_thread __attribute__((tls_model("initial-exec")));
+
+/* Whether the entry points time or trace calls, which they cannot know
+   until mallocInit() has run */
+static bool hooked = true;
+
+static int atexit_registered = 0;
+
+/* Event counters.  Each arena and each thread cache keeps its own set and
+   statsCollect() adds them up when they are read.  num_blocks, mapped
+   and mapped_bytes go down as well as up: they sum to the current state,
+   even if one arena's share wraps around. */
+struct _counters
+{
+   uint64_t num_mallocs;
+   uint64_t num_frees;
+   uint64_t num_reuses;
+   uint64_t num_grows;        /* Calls to the OS for more heap               */
+   uint64_t num_carves;       /* _blocks carved from the wilderness          */
+   uint64_t num_mmaps;
+   uint64_t num_inplace;      /* reallocs that grew without moving           */
+   uint64_t num_moves;        /* reallocs that moved the data                */
+   uint64_t num_switches;     /* Adaptive policy phase changes               */
+   uint64_t num_slabs;        /* Slabs set up for small objects              */
+   uint64_t num_remote;       /* Frees passed to another arena's queue       */
+   uint64_t num_splits;
+   uint64_t num_coalesces;
+   uint64_t num_blocks;
+   uint64_t num_requested;
+   uint64_t max_heap;
+   uint64_t num_trimmed;      /* Bytes given back to the OS from the heap top  */
+   uint64_t num_purged;       /* Bytes of free _blocks dropped by malloc_trim  */
+   uint64_t mapped;           /* Mapped _blocks now                          */
+   uint64_t mapped_bytes;     /* Bytes in their mappings                     */
+};
+
+/*
+ * _blocks sit back to back in memory, so the physically next _block is
+ * found from the size and the physically previous one from prev_size, the
+ * boundary tag, when BLOCK_PREV_INUSE says it is free.  Every run of
+ * _blocks ends in a fence: a zero sized _block that is never free, so
+ * coalescing stops there.
+ */
+struct _block 
+{
+   size_t  prev_size;    /* Size of the previous _block, valid while it is free */
+   size_t  size;         /* Size of the payload in bytes, and the flags above   */
+   struct _block *next_free; /* Free only: next _block in the same class list   */
+   struct _block *prev_free; /* Free only: previous _block in the class list    */
+};
+
+/* Size tree links, kept in the payload of free _blocks above SMALL_LIMIT
+   right after the list links */
+struct _node
+{
+   struct _block *left;
+   struct _block *right;
+   int            height;
+};
+
+#define BLOCK_NODE(b)     ((struct _node *)((b) + 1))
+
+/*
+ * An independent heap: its own lock, free lists and growth region.
+ */
+struct _arena
+{
+   pthread_mutex_t  lock;          /* Protects everything below             */
+   int              index;         /* Position in arenas[]                  */
+   struct _block   *freeHead[NUM_CLASSES]; /* Oldest free _block per class  */
+   struct _block   *freeTail[NUM_CLASSES]; /* Newest free _block per class  */
+   uint64_t         freeMap;       /* Bit c set if class c has a _block     */
+   struct _block   *tree;          /* Root of the size tree                 */
+   size_t           free_bytes;    /* Bytes in free _blocks                 */
+   size_t           free_blocks;   /* Number of free _blocks                */
+   struct _block   *heapEnd;       /* Fence at the end of the growth region */
+   char            *top;           /* End of the wilderness past the fence  */
+   size_t           grow_step;     /* Size of the next call to the OS       */
+   const struct _pages *pages;     /* Where the memory comes from           */
+   char            *clean;         /* Heap memory from here up is still as
+                                      zero as the OS handed it over        */
+   struct _heap    *heap;          /* Newest heap, NULL for the main arena  */
+   struct _block   *last_allocated; // for Next Fit
+   bool             adapt_best;    /* Adaptive policy is in best fit        */
+   unsigned int     adapt_lookups; /* Lookups since the last review         */
+   unsigned long    adapt_visited; /* _blocks next fit visited meanwhile    */
+   struct _slab    *slabs[NUM_SMALL_CLASSES]; /* Slabs with free slots      */
+   void            *remote;        /* Freed by other threads, not locked    */
+   struct _counters stats;
+};
+
+/*
+ * Placement policies.  One is picked in mallocInit() from MALLOC_POLICY,
+ * or from the FIT, NEXT, BEST or WORST macro the library was built with,
+ * before the first _block is freed, and never changes afterwards.  Each
+ * brings the free _block index its search needs.
+ */
+struct _policy
+{
+   const char    *name;
+   struct _block *(*find)(struct _arena *a, size_t size);
+   void           (*insert)(struct _arena *a, struct _block *b);
+   void           (*remove)(struct _arena *a, struct _block *b);
+};
+
+static const struct _policy *policy;
+
+/*
+ * Page sources.  An arena gets its memory through one of these.  "sbrk"
+ * moves the program break and "mmap" reserves PROT_NONE heaps of
+ * HEAP_MAX_SIZE and commits them page by page with mprotect().  Every
+ * heap is one contiguous range aligned to its size, so masking an
+ * address is the bounds check.  The main arena uses the source named by
+ * MALLOC_PAGES, sbrk by default, and switches to mmap for good when the
+ * break cannot move any further.  Other arenas, and the main arena with
+ * huge pages, always use mmap.  Each source keeps a->top, the end of the
+ * wilderness past the fence.
+ */
+struct _pages
+{
+   const char *name;
+   /* Makes memory up to end usable, right behind a->top */
+   bool   (*extend)(struct _arena *a, char *end);
+   /* Starts a new run of _blocks with needed bytes past its fence */
+   bool   (*start)(struct _arena *a, size_t needed);
+   /* Gives back the wilderness from about end up, returns the bytes */
+   size_t (*release)(struct _arena *a, char *end);
+};
+
+enum { PAGES_SBRK, PAGES_MMAP };
+
+/* Header at the start of every heap of a secondary arena */
+struct _heap
+{
+   struct _arena *arena;           /* Arena the heap belongs to             */
+   struct _heap  *prev;            /* Previous heap of the same arena       */
+   size_t         committed;       /* Bytes from the start that are usable  */
+   int            huge;            /* HUGE_OFF, HUGE_THP or HUGE_TLB        */
+};
+
+/*
+ * User arenas, from src/malloc_arena.h, are regions rather than arenas
+ * of the allocator: they bump allocate through heaps of their own that
+ * no _arena knows about, committing REGION_COMMIT bytes at a time.
+ * Requests of REGION_BIG bytes or more get a mapping of their own
+ * instead.
+ */
+#define REGION_COMMIT     (64 * 1024)
+#define REGION_BIG        (HEAP_MAX_SIZE / 4)
+
+/* Header at the start of a user arena's own mapping for a large request */
+struct _mapping
+{
+   struct _mapping *next;          /* Other mappings of the user arena      */
+   size_t           length;        /* Bytes mapped                          */
+};
+
+/* A user arena, kept in its first heap right after the _heap header */
+struct arena
+{
+   struct _heap    *heap;          /* Newest heap, the one being carved     */
+   char            *next;          /* First unused byte in it               */
+   struct _mapping *big;           /* Mappings of large requests            */
+};
+
+/* Header at the start of every slab */
+struct _slab
+{
+   struct _arena  *arena;          /* Arena the slab belongs to             */
+   struct _slab   *next;           /* Next slab with free slots, or next    */
+   struct _slab   *prev;           /* empty slab in slab_free               */
+   unsigned short  class;          /* Size class of the objects             */
+   unsigned short  size;           /* Bytes per slot                        */
+   unsigned short  total;          /* Number of slots                       */
+   unsigned short  used;           /* Slots in use                          */
+   unsigned short  hint;           /* No free slot in map words below this  */
+   uint64_t        map[SLAB_WORDS]; /* Bit set for every free slot          */
+};
+
+static struct _arena  main_arena = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static struct _arena *arenas[MAX_ARENAS] = { &main_arena };
+static int            num_arenas = 1;
+static unsigned int   next_arena = 0;   /* Round robin when no CPU number */
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t         page_size = 4096;
+
+/* Bounds of the sbrk memory, which belongs to the main arena */
+static char *main_lo = NULL;
+static char *main_hi = NULL;
+
+/* The slab region.  Slabs are handed out from slab_next upwards, and
+   empty ones are given back to slab_free.  malloc_trim() drops the pages
+   of those and marks them in slab_dropped instead, as a dropped page
+   cannot keep the link. */
+static char           *slab_lo = NULL;
+static char           *slab_next = NULL;
+static char           *slab_committed = NULL;
+static struct _slab   *slab_free = NULL;
+static uint64_t        slab_dropped[SLAB_REGION_SIZE / SLAB_SIZE / 64];
+static size_t          slab_num_dropped = 0;
+static size_t          slab_drop_hint = 0;  /* No bits below this word     */
+static uint64_t        slab_purged = 0;     /* Bytes of slabs dropped      */
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct _arena *thread_arena __attribute__((tls_model("initial-exec")));
+
+/* Set by heapAlloc() when it grew the heap: the data of the _block is
+   zero from here on, so calloc need not clear that part */
+static __thread char *fresh_from __attribute__((tls_model("initial-exec")));
+
+/*
+ * Per thread cache of recently freed small objects: slab objects with
+ * slabs on, _blocks otherwise.  Cached _blocks stay marked in use, so
+ * they are never coalesced.  Objects are linked through their first
+ * word.  malloc and free only take an arena
+ * lock to refill an empty bin or to flush half of a full one.  Counters
+ * for calls served from the cache are kept here.  Every cache is on
+ * tcache_list so statsCollect() can read them, and adds its counters to
+ * tcache_exited when its thread exits.
+ */
+#define TCACHE_MAX        32
+#define TCACHE_FILL       (TCACHE_MAX / 2)
+
+/* Only the owning thread writes the counters of a cache, but others read
+   them, so each update is a single relaxed store */
+#define TCACHE_COUNT(tc, field, n) \
+   __atomic_store_n(&(tc)->stats.field, (tc)->stats.field + (n), __ATOMIC_RELAXED)
+
+struct _tcache
+{
+   void         *bins[NUM_SMALL_CLASSES];   /* Cached objects per class   */
+   unsigned int  count[NUM_SMALL_CLASSES];  /* Number of cached objects   */
+   bool          registered;               /* Destructor key is set      */
+   bool          disabled;                 /* Thread is exiting          */
+   struct _tcache *next;                   /* Other caches on tcache_list */
+   struct _tcache *prev;
+   struct _counters stats;
+};
+
+static __thread struct _tcache tcache __attribute__((tls_model("initial-exec")));
+static pthread_key_t tcache_key;
+
+static struct _tcache  *tcache_list = NULL;
+static struct _counters tcache_exited;
+static pthread_mutex_t  tcache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void remoteDrain(struct _arena *a);
+static void statsCollect(struct malloc_stats_info *info);
+static size_t largestFree(struct _arena *a);
+
+/*
+ * \brief latencyTicks
+ *
+ * \return the time stamp counter, or nanoseconds where there is none
+ */
+static inline uint64_t latencyTicks(void)
+{
+#if defined __x86_64__ || defined __i386__
+   return __rdtsc();
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+ * \brief latencyBucket
+ *
+ * \param ticks a duration
+ *
+ * \return the histogram bucket of the duration
+ */
+static inline int latencyBucket(uint64_t ticks)
+{
+   if (ticks < LAT_SUB)
+   {
+      return ticks;
+   }
+
+   int e = 63 - __builtin_clzll(ticks);
+   return (e - LAT_SUB_BITS + 1) * LAT_SUB + ((ticks >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/*
+ * \brief latencyValue
+ *
+ * \param b a histogram bucket
+ *
+ * \return the smallest duration that falls into the bucket
+ */
+static inline uint64_t latencyValue(int b)
+{
+   if (b < LAT_SUB)
+   {
+      return b;
+   }
+
+   int e = b / LAT_SUB + LAT_SUB_BITS - 1;
+   return (uint64_t)(LAT_SUB + b % LAT_SUB) << (e - LAT_SUB_BITS);
+}
+
+/*
+ * \brief latencyRecord
+ *
+ * Counts a timed call under its size and under the path it took.
+ *
+ * \param op the entry point, LAT_MALLOC to LAT_REALLOC
+ * \param size size of the request or of the freed object in bytes
+ * \param start latencyTicks() when the call started
+ *
+ * \return none
+ */
+static void latencyRecord(int op, size_t size, uint64_t start)
+{
+   int b = latencyBucket(latencyTicks() - start);
+   int g = size <= 16 ? 0 : 64 - __builtin_clzl(size - 1) - 4;
+
+   if (g >= LAT_SIZES)
+   {
+      g = LAT_SIZES - 1;
+   }
+
+   __atomic_fetch_add(&lat_size[op][g][b], 1, __ATOMIC_RELAXED);
+   __atomic_fetch_add(&lat_paths[op][lat_path][b], 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * \brief traceOpen
+ *
+ * Creates the trace file and maps its ring of events.  The file is sized
+ * up front and left sparse, so the mapping never runs past its end.
+ *
+ * \param name file name, with "%p" standing for the process id
+ * \param bytes size of the ring in bytes
+ *
+ * \return true if tracing can start
+ */
+static bool traceOpen(const char *name, size_t bytes)
+{
+   char path[4096];
+   size_t len = 0;
+
+   for (const char *c = name; *c && len < sizeof(path) - 24; c++)
+   {
+      if (c[0] == '%' && c[1] == 'p')
+      {
+         len += snprintf(path + len, 24, "%d", (int)getpid());
+         c++;
+      }
+      else
+      {
+         path[len++] = *c;
+      }
+   }
+   path[len] = '\0';
+
+   uint64_t capacity = bytes / sizeof(struct malloc_trace_event);
+   size_t length = sizeof(struct malloc_trace_header) +
+                   capacity * sizeof(struct malloc_trace_event);
+   if (capacity == 0)
+   {
+      return false;
+   }
+
+   int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   if (fd < 0)
+   {
+      return false;
+   }
+
+   void *map = MAP_FAILED;
+   if (ftruncate(fd, length) == 0)
+   {
+      map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   }
+   close(fd);
+   if (map == MAP_FAILED)
+   {
+      return false;
+   }
+
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   trace_start_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+   clock_gettime(CLOCK_REALTIME, &ts);
+
+   trace_header = map;
+   trace_header->magic = MALLOC_TRACE_MAGIC;
+   trace_header->capacity = capacity;
+   trace_header->count = 0;
+   trace_header->start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+   trace_events = (struct malloc_trace_event *)(trace_header + 1);
+
+   return true;
+}
+
+/*
+ * \brief traceRecord
+ *
+ * Logs one call.  Frees are logged before the memory is given back and
+ * allocations after they return, so an address that is reused shows up
+ * freed before it is handed out again.
+ *
+ * \param op MALLOC_TRACE_MALLOC ...
+ * \param ptr pointer returned or freed
+ * \param arg old pointer of a realloc, alignment of an aligned allocation
+ * \param size requested size in bytes
+ *
+ * \return none
+ */
+static void traceRecord(uint32_t op, void *ptr, uint64_t arg, size_t size)
+{
+   if (trace_thread == 0)
+   {
+      trace_thread = gettid();
+   }
+
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   uint64_t n = __atomic_fetch_add(&trace_header->count, 1, __ATOMIC_RELAXED);
+   struct malloc_trace_event *e = &trace_events[n % trace_header->capacity];
+
+   e->time = ts.tv_sec * 1000000000ULL + ts.tv_nsec - trace_start_ns;
+   e->ptr = (uintptr_t)ptr;
+   e->arg = arg;
+   e->size = size;
+   e->thread = trace_thread;
+   e->op = op;
+}
+
+/*
+ * \brief countersAdd
+ *
+ * \param sum counters to add to
+ * \param c counters to add, which another thread may be updating
+ *
+ * \return none
+ */
+static void countersAdd(struct _counters *sum, struct _counters *c)
+{
+#define ADD(field) sum->field += __atomic_load_n(&c->field, __ATOMIC_RELAXED)
+   ADD(num_mallocs);
+   ADD(num_frees);
+   ADD(num_reuses);
+   ADD(num_grows);
+   ADD(num_carves);
+   ADD(num_mmaps);
+   ADD(num_inplace);
+   ADD(num_moves);
+   ADD(num_switches);
+   ADD(num_slabs);
+   ADD(num_remote);
+   ADD(num_splits);
+   ADD(num_coalesces);
+   ADD(num_blocks);
+   ADD(num_requested);
+   ADD(max_heap);
+   ADD(num_trimmed);
+   ADD(num_purged);
+   ADD(mapped);
+   ADD(mapped_bytes);
+#undef ADD
+}
+
+/*
+ * \brief statsWrite
+ *
+ * Writes the heap statistics to a file descriptor.  Formats them on the
+ * stack and writes them directly, so it never calls malloc.
+ *
+ * \param fd the file descriptor
+ *
+ * \return none
+ */
+static void statsWrite(int fd)
+{
+  struct malloc_stats_info st;
+  statsCollect(&st);
+
+  char buf[2048];
+  int len = snprintf(buf, sizeof(buf),
+     "\nheap management statistics\n"
+     "policy:\t\t%s\n"
+     "mallocs:\t%" PRIu64 "\n"
+     "frees:\t\t%" PRIu64 "\n"
+     "reuses:\t\t%" PRIu64 "\n"
+     "grows:\t\t%" PRIu64 "\n"
+     "carves:\t\t%" PRIu64 "\n"
+     "mmaps:\t\t%" PRIu64 "\n"
+     "in place:\t%" PRIu64 "\n"
+     "moves:\t\t%" PRIu64 "\n"
+     "switches:\t%" PRIu64 "\n"
+     "slabs:\t\t%" PRIu64 "\n"
+     "remote:\t\t%" PRIu64 "\n"
+     "splits:\t\t%" PRIu64 "\n"
+     "coalesces:\t%" PRIu64 "\n"
+     "blocks:\t\t%" PRIu64 "\n"
+     "requested:\t%" PRIu64 "\n"
+     "max heap:\t%" PRIu64 "\n"
+     "trimmed:\t%" PRIu64 "\n"
+     "purged:\t\t%" PRIu64 "\n"
+     "mapped:\t\t%" PRIu64 "\n"
+     "huge pages:\t%" PRIu64 "\n"
+     "free:\t\t%" PRIu64 "\n"
+     "largest free:\t%" PRIu64 "\n"
+     "fragmentation:\t%.1f%%\n",
+     policy->name, st.mallocs, st.frees, st.reuses, st.grows, st.carves, st.mmaps,
+     st.inplace, st.moves, st.switches, st.slabs, st.remote, st.splits,
+     st.coalesces, st.blocks, st.requested, st.max_heap, st.trimmed,
+     st.purged, st.mmap_bytes, st.huge_bytes, st.free_bytes, st.largest_free,
+     st.fragmentation * 100);
+
+  for (int done = 0; done < len; )
+  {
+     ssize_t n = write(fd, buf + done, len - done);
+     if (n <= 0)
+     {
+        break;
+     }
+     done += n;
+  }
+}
+
+/*
+ * \brief latencyRow
+ *
+ * Writes one line of a latency table: the number of calls and their
+ * p50, p99, p99.9 and maximum in nanoseconds, each the middle of its
+ * bucket.
+ *
+ * \param fd the file descriptor
+ * \param label what the calls have in common
+ * \param hist the histogram of the calls
+ * \param ns_per_tick length of a tick in nanoseconds
+ *
+ * \return none
+ */
+static void latencyRow(int fd, const char *label, uint64_t *hist, double ns_per_tick)
+{
+   static const double quantiles[] = { 0.5, 0.99, 0.999, 1.0 };
+   double values[4];
+   uint64_t total = 0;
+
+   for (int b = 0; b < LAT_BUCKETS; b++)
+   {
+      total += __atomic_load_n(&hist[b], __ATOMIC_RELAXED);
+   }
+   if (total == 0)
+   {
+      return;
+   }
+
+   for (int q = 0; q < 4; q++)
+   {
+      uint64_t rank = (uint64_t)(quantiles[q] * total + 0.5);
+      uint64_t seen = 0;
+      int b = 0;
+
+      rank = rank < 1 ? 1 : rank > total ? total : rank;
+      while (b < LAT_BUCKETS - 1 &&
+             (seen += __atomic_load_n(&hist[b], __ATOMIC_RELAXED)) < rank)
+      {
+         b++;
+      }
+
+      uint64_t lo = latencyValue(b);
+      uint64_t hi = b < LAT_BUCKETS - 1 ? latencyValue(b + 1) : lo;
+      values[q] = (lo + hi) / 2.0 * ns_per_tick;
+   }
+
+   char buf[160];
+   int len = snprintf(buf, sizeof(buf), "  %-12s %12" PRIu64 " %9.0f %9.0f %9.0f %9.0f\n",
+                      label, total, values[0], values[1], values[2], values[3]);
+   if (write(fd, buf, len) < 0)
+   {
+      return;
+   }
+}
+
+/*
+ * \brief latencyWrite
+ *
+ * Writes a latency table for every entry point that was called, by path
+ * and by size, without calling malloc.
+ *
+ * \param fd the file descriptor
+ *
+ * \return none
+ */
+static void latencyWrite(int fd)
+{
+   static const char *ops[LAT_OPS] = { "malloc", "free", "calloc", "realloc" };
+   static const char *paths[LAT_PATHS] =
+   {
+      "other", "cache", "slab", "reuse", "split", "grow",
+      "mmap", "remote", "coalesce", "in place", "move"
+   };
+
+   double ns_per_tick = 1.0;
+#if defined __x86_64__ || defined __i386__
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   uint64_t ticks = latencyTicks() - lat_start_ticks;
+   if (ticks > 0)
+   {
+      ns_per_tick = (ts.tv_sec * 1000000000ULL + ts.tv_nsec - lat_start_ns) / (double)ticks;
+   }
+#endif
+
+   for (int op = 0; op < LAT_OPS; op++)
+   {
+      char buf[160];
+      int len = snprintf(buf, sizeof(buf), "\n%s latency (ns)\n  %-12s %12s %9s %9s %9s %9s\n",
+                         ops[op], "", "calls", "p50", "p99", "p99.9", "max");
+      if (write(fd, buf, len) < 0)
+      {
+         return;
+      }
+
+      for (int p = 0; p < LAT_PATHS; p++)
+      {
+         latencyRow(fd, paths[p], lat_paths[op][p], ns_per_tick);
+      }
+
+      for (int g = 0; g < LAT_SIZES; g++)
+      {
+         char label[16];
+         size_t size = (size_t)16 << g;
+         if (g == LAT_SIZES - 1)
+         {
+            snprintf(label, sizeof(label), "> %zuM", size >> 21);
+         }
+         else if (size >= 1024 * 1024)
+         {
+            snprintf(label, sizeof(label), "<= %zuM", size >> 20);
+         }
+         else if (size >= 1024)
+         {
+            snprintf(label, sizeof(label), "<= %zuK", size >> 10);
+         }
+         else
+         {
+            snprintf(label, sizeof(label), "<= %zu", size);
+         }
+         latencyRow(fd, label, lat_size[op][g], ns_per_tick);
+      }
+   }
+}
+
+/*
+ *  \brief printLatency
+ *
+ *  Prints the latency tables to stderr at exit.  Registered via atexit()
+ *  when MALLOC_LATENCY is set.
+ *
+ *  \return none
+ */
+static void printLatency( void )
+{
+  latencyWrite(STDERR_FILENO);
+}
+
+/*
+ *  \brief printStatistics
+ *
+ *  \param none
+ *
+ *  Prints the heap statistics upon process exit, after anything the
+ *  program left in the stdout buffer.  Registered via atexit() when
+ *  print_stats is set.
+ *
+ *  \return none
+ */
+void printStatistics( void )
+{
+  fflush(stdout);
+  statsWrite(STDOUT_FILENO);
+}
+
+/*
+ * \brief blockSize
+ *
+ * \param size size of a request in bytes
+ *
+ * \return size of the smallest _block that holds it: at least BLOCK_MIN
+ * and BLOCK_OVERHEAD short of a multiple of ALIGNMENT
+ */
+static inline size_t blockSize(size_t size)
+{
+   size = ALIGN(size + BLOCK_OVERHEAD) - BLOCK_OVERHEAD;
+
+   return size < BLOCK_MIN ? BLOCK_MIN : size;
+}
+
+/*
+ * \brief sizeClass
+ *
+ * \param size size of a _block, or of a slab object, in bytes
+ *
+ * \return index of the free list class holding _blocks of that size; a
+ * small class holds _blocks of class_size - BLOCK_OVERHEAD bytes and slab
+ * objects of class_size bytes
+ */
+static inline int sizeClass(size_t size)
+{
+   if (size <= SMALL_LIMIT)
+   {
+      return (size - 1) / ALIGNMENT;
+   }
+
+   int c = NUM_SMALL_CLASSES + 63 - __builtin_clzl((size - 1) / SMALL_LIMIT);
+   if (c >= NUM_CLASSES)
+   {
+      c = NUM_CLASSES - 1;
+   }
+
+   assert(size <= class_size[c]);
+   return c;
+}
+
+/*
+ * \brief nextClass
+ *
+ * \param a the arena to search
+ * \param c first class to consider
+ *
+ * \return the lowest non-empty class at or above c, or -1 if there is none
+ */
+static inline int nextClass(struct _arena *a, int c)
+{
+   if (c >= NUM_CLASSES)
+   {
+      return -1;
+   }
+
+   uint64_t above = a->freeMap & (~0ULL << c);
+   return above ? __builtin_ctzll(above) : -1;
+}
+
+/*
+ * \brief treeHeight
+ *
+ * \param b a tree node or NULL
+ *
+ * \return height of the subtree rooted at b, 0 for an empty one
+ */
+static inline int treeHeight(struct _block *b)
+{
+   return b ? BLOCK_NODE(b)->height : 0;
+}
+
+/*
+ * \brief treeBefore
+ *
+ * \return true if _block x sorts before _block y: smaller, or as large and
+ * at a lower address
+ */
+static inline bool treeBefore(struct _block *x, struct _block *y)
+{
+   return BLOCK_SIZE(x) < BLOCK_SIZE(y) || (BLOCK_SIZE(x) == BLOCK_SIZE(y) && x < y);
+}
+
+/*
+ * \brief treeRotate
+ *
+ * Rotates the subtree rooted at b so that its left child, or its right
+ * child if left is false, becomes the new root.
+ *
+ * \param b root of the subtree
+ * \param left direction of the rotation
+ *
+ * \return the new root
+ */
+static struct _block *treeRotate(struct _block *b, bool left)
+{
+   struct _node *n = BLOCK_NODE(b);
+   struct _block *r = left ? n->left : n->right;
+   struct _node *rn = BLOCK_NODE(r);
+
+   if (left)
+   {
+      n->left = rn->right;
+      rn->right = b;
+   }
+   else
+   {
+      n->right = rn->left;
+      rn->left = b;
+   }
+
+   n->height = 1 + (treeHeight(n->left) > treeHeight(n->right) ?
+                    treeHeight(n->left) : treeHeight(n->right));
+   rn->height = 1 + (treeHeight(rn->left) > treeHeight(rn->right) ?
+                     treeHeight(rn->left) : treeHeight(rn->right));
+
+   return r;
+}
+
+/*
+ * \brief treeBalance
+ *
+ * Restores the AVL invariant at b after one of its subtrees changed
+ * height by one.
+ *
+ * \param b root of the subtree
+ *
+ * \return the new root
+ */
+static struct _block *treeBalance(struct _block *b)
+{
+   struct _node *n = BLOCK_NODE(b);
+   int diff = treeHeight(n->left) - treeHeight(n->right);
+
+   if (diff > 1)
+   {
+      struct _node *l = BLOCK_NODE(n->left);
+      if (treeHeight(l->left) < treeHeight(l->right))
+      {
+         n->left = treeRotate(n->left, false);
+      }
+      return treeRotate(b, true);
+   }
+
+   if (diff < -1)
+   {
+      struct _node *r = BLOCK_NODE(n->right);
+      if (treeHeight(r->right) < treeHeight(r->left))
+      {
+         n->right = treeRotate(n->right, true);
+      }
+      return treeRotate(b, false);
+   }
+
+   n->height = 1 + (diff > 0 ? treeHeight(n->left) : treeHeight(n->right));
+   return b;
+}
+
+/*
+ * \brief treeInsert
+ *
+ * \param root root of the subtree
+ * \param b the _block to insert
+ *
+ * \return the new root
+ */
+static struct _block *treeInsert(struct _block *root, struct _block *b)
+{
+   if (root == NULL)
+   {
+      struct _node *n = BLOCK_NODE(b);
+      n->left = n->right = NULL;
+      n->height = 1;
+      return b;
+   }
+
+   struct _node *n = BLOCK_NODE(root);
+   if (treeBefore(b, root))
+   {
+      n->left = treeInsert(n->left, b);
+   }
+   else
+   {
+      n->right = treeInsert(n->right, b);
+   }
+
+   return treeBalance(root);
+}
+
+/*
+ * \brief treeRemove
+ *
+ * \param root root of the subtree, which must contain b
+ * \param b the _block to remove
+ *
+ * \return the new root
+ */
+static struct _block *treeRemove(struct _block *root, struct _block *b)
+{
+   struct _node *n = BLOCK_NODE(root);
+
+   if (root != b)
+   {
+      if (treeBefore(b, root))
+      {
+         n->left = treeRemove(n->left, b);
+      }
+      else
+      {
+         n->right = treeRemove(n->right, b);
+      }
+      return treeBalance(root);
+   }
+
+   if (n->left == NULL || n->right == NULL)
+   {
+      return n->left ? n->left : n->right;
+   }
+
+   /* Replace b by its successor, the leftmost node on the right */
+   struct _block *next = n->right;
+   while (BLOCK_NODE(next)->left)
+   {
+      next = BLOCK_NODE(next)->left;
+   }
+
+   struct _node *nn = BLOCK_NODE(next);
+   nn->right = treeRemove(n->right, next);
+   nn->left = n->left;
+
+   return treeBalance(next);
+}
+
+/*
+ * \brief treeLowerBound
+ *
+ * \param root root of the tree
+ * \param size size needed in bytes
+ *
+ * \return the smallest _block of at least size bytes, the lowest
+ * addressed one among equals, or NULL if there is none
+ */
+static struct _block *treeLowerBound(struct _block *root, size_t size)
+{
+   struct _block *found = NULL;
+
+   while (root)
+   {
+      if (BLOCK_SIZE(root) >= size)
+      {
+         found = root;
+         root = BLOCK_NODE(root)->left;
+      }
+      else
+      {
+         root = BLOCK_NODE(root)->right;
+      }
+   }
+
+   return found;
+}
+
+/*
+ * \brief treeLast
+ *
+ * \param root root of a non-empty tree
+ *
+ * \return the largest _block, the highest addressed one among equals
+ */
+static inline struct _block *treeLast(struct _block *root)
+{
+   while (BLOCK_NODE(root)->right)
+   {
+      root = BLOCK_NODE(root)->right;
+   }
+
+   return root;
+}
+
+/*
+ * \brief listInsert
+ *
+ * Appends a free _block to the tail of its class list so that _blocks are
+ * handed out in the order they were freed.
+ *
+ * \param a the arena owning the _block
+ * \param b the _block to insert
+ *
+ * \return none
+ */
+static void listInsert(struct _arena *a, struct _block *b)
+{
+   int c = sizeClass(BLOCK_SIZE(b));
+
+   b->next_free = NULL;
+   b->prev_free = a->freeTail[c];
+
+   if (a->freeTail[c])
+   {
+      a->freeTail[c]->next_free = b;
+   }
+   else
+   {
+      a->freeHead[c] = b;
+      a->freeMap |= 1ULL << c;
+   }
+   a->freeTail[c] = b;
+}
+
+/*
+ * \brief listRemove
+ *
+ * Unlinks a _block from its class list.
+ *
+ * \param a the arena owning the _block
+ * \param b the _block to remove
+ *
+ * \return none
+ */
+static void listRemove(struct _arena *a, struct _block *b)
+{
+   int c = sizeClass(BLOCK_SIZE(b));
+
+   if (b->prev_free)
+   {
+      b->prev_free->next_free = b->next_free;
+   }
+   else
+   {
+      a->freeHead[c] = b->next_free;
+   }
+
+   if (b->next_free)
+   {
+      b->next_free->prev_free = b->prev_free;
+   }
+   else
+   {
+      a->freeTail[c] = b->prev_free;
+   }
+
+   if (a->freeHead[c] == NULL)
+   {
+      a->freeMap &= ~(1ULL << c);
+   }
+}
+
+/*
+ * \brief sizedInsert
+ *
+ * Index for best and worst fit: _blocks above SMALL_LIMIT go to the
+ * size tree, smaller ones to their exact class list.
+ *
+ * \param a the arena owning the _block
+ * \param b the _block to insert
+ *
+ * \return none
+ */
+static void sizedInsert(struct _arena *a, struct _block *b)
+{
+   if (BLOCK_SIZE(b) > SMALL_LIMIT)
+   {
+      a->tree = treeInsert(a->tree, b);
+   }
+   else
+   {
+      listInsert(a, b);
+   }
+}
+
+static void sizedRemove(struct _arena *a, struct _block *b)
+{
+   if (BLOCK_SIZE(b) > SMALL_LIMIT)
+   {
+      a->tree = treeRemove(a->tree, b);
+   }
+   else
+   {
+      listRemove(a, b);
+   }
+}
+
+/*
+ * \brief bothInsert
+ *
+ * Index for the adaptive policy: every _block is on its class list for
+ * next fit, and those above SMALL_LIMIT are in the size tree as well for
+ * best fit.  The tree links live in the payload, so the two never clash.
+ *
+ * \param a the arena owning the _block
+ * \param b the _block to insert
+ *
+ * \return none
+ */
+static void bothInsert(struct _arena *a, struct _block *b)
+{
+   listInsert(a, b);
+   if (BLOCK_SIZE(b) > SMALL_LIMIT)
+   {
+      a->tree = treeInsert(a->tree, b);
+   }
+}
+
+static void bothRemove(struct _arena *a, struct _block *b)
+{
+   listRemove(a, b);
+   if (BLOCK_SIZE(b) > SMALL_LIMIT)
+   {
+      a->tree = treeRemove(a->tree, b);
+   }
+}
+
+/*
+ * \brief searchFirst
+ *
+ * First fit within a single class list: the oldest free _block that is
+ * big enough.  Exact classes never hold a _block too small for the
+ * request, so their head is returned without a search.
+ *
+ * \param a the arena to search
+ * \param c class to search
+ * \param size size of the _block needed in bytes 
+ *
+ * \return a _block from class c that fits the request or NULL
+ */
+static inline struct _block *searchFirst(struct _arena *a, int c, size_t size)
+{
+   struct _block *curr = a->freeHead[c];
+
+   if (c < NUM_SMALL_CLASSES)
+   {
+      return curr;
+   }
+
+   while (curr && BLOCK_SIZE(curr) < size)
+   {
+      curr = curr->next_free;
+   }
+
+   return curr;
+}
+
+/*
+ * \brief searchNext
+ *
+ * Next fit within a single class list: the first _block past the last
+ * allocation, wrapping around to the lowest addressed _block in the
+ * class that is big enough.  The number of _blocks visited feeds the
+ * adaptive policy.
+ *
+ * \param a the arena to search
+ * \param c class to search
+ * \param size size of the _block needed in bytes 
+ *
+ * \return a _block from class c that fits the request or NULL
+ */
+static inline struct _block *searchNext(struct _arena *a, int c, size_t size)
+{
+   struct _block *curr = a->freeHead[c];
+
+   if (c < NUM_SMALL_CLASSES)
+   {
+      return curr;
+   }
+
+   struct _block *after = NULL;
+   struct _block *lowest = NULL;
+   while (curr)
+   {
+      if (BLOCK_SIZE(curr) >= size)
+      {
+         if (curr > a->last_allocated && (after == NULL || curr < after))
+         {
+            after = curr;
+         }
+         if (lowest == NULL || curr < lowest)
+         {
+            lowest = curr;
+         }
+      }
+      curr = curr->next_free;
+      a->adapt_visited++;
+   }
+
+   return after ? after : lowest;
+}
+
+/*
+ * \brief searchClasses
+ *
+ * Runs a class search over the matching size class first and then over
+ * the lowest non-empty class above it, where every _block is big enough.
+ *
+ * \param a the arena to search
+ * \param size size of the _block needed in bytes 
+ * \param search searchFirst or searchNext
+ *
+ * \return a _block that fits the request or NULL
+ */
+static inline struct _block *searchClasses(struct _arena *a, size_t size,
+      struct _block *(*search)(struct _arena *, int, size_t))
+{
+   int c = sizeClass(size);
+   struct _block *curr = search(a, c, size);
+
+   if (curr == NULL)
+   {
+      c = nextClass(a, c + 1);
+      if (c >= 0)
+      {
+         curr = search(a, c, size);
+      }
+   }
+
+   return curr;
+}
+
+static struct _block *findFirst(struct _arena *a, size_t size)
+{
+   return searchClasses(a, size, searchFirst);
+}
+
+static struct _block *findNext(struct _arena *a, size_t size)
+{
+   struct _block *curr = searchClasses(a, size, searchNext);
+
+   if (curr)
+   {
+      a->last_allocated = curr;
+   }
+
+   return curr;
+}
+
+/*
+ * \brief findBest
+ *
+ * The smallest fitting _block is in the first non-empty exact class, or
+ * else the first one in the size tree that is big enough.
+ *
+ * \param a the arena to search
+ * \param size size of the _block needed in bytes 
+ *
+ * \return a _block that fits the request or NULL
+ */
+static struct _block *findBest(struct _arena *a, size_t size)
+{
+   int c = nextClass(a, sizeClass(size));
+
+   if (c >= 0 && c < NUM_SMALL_CLASSES)
+   {
+      return a->freeHead[c];
+   }
+
+   return treeLowerBound(a->tree, size);
+}
+
+/*
+ * \brief findWorst
+ *
+ * The largest free _block is the rightmost one in the size tree, or else
+ * in the highest non-empty exact class.  Among _blocks of that size the
+ * one at the lowest address wins, as in the tree.
+ *
+ * \param a the arena to search
+ * \param size size of the _block needed in bytes 
+ *
+ * \return a _block that fits the request or NULL
+ */
+static struct _block *findWorst(struct _arena *a, size_t size)
+{
+   if (a->tree)
+   {
+      struct _block *curr = treeLast(a->tree);
+      return BLOCK_SIZE(curr) >= size ? treeLowerBound(a->tree, BLOCK_SIZE(curr)) : NULL;
+   }
+
+   if (a->freeMap == 0 || 63 - __builtin_clzll(a->freeMap) < sizeClass(size))
+   {
+      return NULL;
+   }
+
+   struct _block *worst = a->freeHead[63 - __builtin_clzll(a->freeMap)];
+   for (struct _block *b = worst->next_free; b; b = b->next_free)
+   {
+      if (b < worst)
+      {
+         worst = b;
+      }
+   }
+
+   return worst;
+}
+
+/*
+ * \brief findAdaptive
+ *
+ * Next fit while it finds _blocks quickly and the free space stays in
+ * one piece, best fit otherwise.  Every ADAPT_WINDOW lookups the arena
+ * looks at how many _blocks next fit visited per lookup and at how much
+ * of the free space lies outside the largest free _block, and switches
+ * phase when either crosses its limit.
+ *
+ * \param a the arena to search
+ * \param size size of the _block needed in bytes 
+ *
+ * \return a _block that fits the request or NULL
+ */
+static struct _block *findAdaptive(struct _arena *a, size_t size)
+{
+   if (++a->adapt_lookups == ADAPT_WINDOW)
+   {
+      size_t largest = largestFree(a);
+      size_t frag = a->free_bytes > largest ? 100 - 100 * largest / a->free_bytes : 0;
+
+      bool best = a->adapt_best
+                ? frag > ADAPT_FRAG_LOW
+                : frag > ADAPT_FRAG_HIGH ||
+                  a->adapt_visited > ADAPT_SEARCH * ADAPT_WINDOW;
+      if (best != a->adapt_best)
+      {
+         a->adapt_best = best;
+         a->stats.num_switches++;
+      }
+
+      a->adapt_lookups = 0;
+      a->adapt_visited = 0;
+   }
+
+   return a->adapt_best ? findBest(a, size) : findNext(a, size);
+}
+
+static const struct _policy policies[] =
+{
+   { "first",    findFirst,    listInsert,  listRemove  },
+   { "next",     findNext,     listInsert,  listRemove  },
+   { "best",     findBest,     sizedInsert, sizedRemove },
+   { "worst",    findWorst,    sizedInsert, sizedRemove },
+   { "adaptive", findAdaptive, bothInsert,  bothRemove  },
+};
+
+#if defined NEXT && NEXT == 0
+static const struct _policy *policy = &policies[1];
+#elif defined BEST && BEST == 0
+static const struct _policy *policy = &policies[2];
+#elif defined WORST && WORST == 0
+static const struct _policy *policy = &policies[3];
+#else
+static const struct _policy *policy = &policies[0];
+#endif
+
+/*
+ * \brief freeListInsert
+ *
+ * Adds a free _block to the index of the placement policy.
+ *
+ * \param a the arena owning the _block
+ * \param b the _block to insert
+ *
+ * \return none
+ */
+static inline void freeListInsert(struct _arena *a, struct _block *b)
+{
+   a->free_bytes += BLOCK_SIZE(b);
+   a->free_blocks++;
+   policy->insert(a, b);
+}
+
+/*
+ * \brief freeListRemove
+ *
+ * Takes a _block out of the index of the placement policy.  Must be
+ * called before the size of the _block changes.
+ *
+ * \param a the arena owning the _block
+ * \param b the _block to remove
+ *
+ * \return none
+ */
+static inline void freeListRemove(struct _arena *a, struct _block *b)
+{
+   a->free_bytes -= BLOCK_SIZE(b);
+   a->free_blocks--;
+   policy->remove(a, b);
+}
+
+/*
+ * \brief findFreeBlock
+ *
+ * Runs the placement policy over the free _blocks of an arena.
+ *
+ * \param a the arena to search
+ * \param size size of the _block needed in bytes 
+ *
+ * \return a _block that fits the request or NULL if no free _block matches
+ */
+struct _block *findFreeBlock(struct _arena *a, size_t size)
+{
+   return policy->find(a, size);
+}
+
+/*
+ * \brief heapUnit
+ *
+ * \param h a heap
+ *
+ * \return the step the heap commits and releases memory in
+ */
+static inline size_t heapUnit(struct _heap *h)
+{
+   return h->huge != HUGE_OFF ? HUGE_PAGE_SIZE : page_size;
+}
+
+/*
+ * \brief heapCommit
+ *
+ * Makes the pages of a heap up to end readable and writable.
+ *
+ * \param h the heap
+ * \param end first byte past the range that must be usable
+ *
+ * \return true on success, false if the range does not fit or mprotect fails
+ */
+static bool heapCommit(struct _heap *h, char *end)
+{
+   size_t needed = end - (char *)h;
+   size_t unit = heapUnit(h);
+
+   if (needed > HEAP_MAX_SIZE)
+   {
+      return false;
+   }
+
+   if (needed > h->committed)
+   {
+      needed = (needed + unit - 1) & ~(unit - 1);
+      if (mprotect((char *)h + h->committed, needed - h->committed,
+                   PROT_READ | PROT_WRITE) != 0)
+      {
+         return false;
+      }
+      h->committed = needed;
+   }
+
+   return true;
+}
+
+/*
+ * \brief heapCreate
+ *
+ * Reserves a new heap aligned to HEAP_MAX_SIZE and commits its first page.
+ *
+ * \param a the arena the heap is for, or NULL while the arena is created
+ *
+ * \return the new heap or NULL if the reservation failed
+ */
+static struct _heap *heapCreate(struct _arena *a)
+{
+   int huge = huge_pages;
+   char *p = MAP_FAILED;
+
+   /* Reserve twice the size and trim it down to an aligned region.  The
+      huge pages are reserved up front, so a short pool fails here and
+      not with SIGBUS on some later fault. */
+   if (huge == HUGE_TLB)
+   {
+      p = mmap(NULL, 2 * HEAP_MAX_SIZE, PROT_NONE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED)
+      {
+         huge = HUGE_THP;
+      }
+   }
+   if (p == MAP_FAILED)
+   {
+      p = mmap(NULL, 2 * HEAP_MAX_SIZE, PROT_NONE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   }
+   if (p == MAP_FAILED)
+   {
+      return NULL;
+   }
+
+   char *aligned = (char *)(((uintptr_t)p + HEAP_MAX_SIZE - 1) & ~(HEAP_MAX_SIZE - 1));
+   if (aligned > p)
+   {
+      munmap(p, aligned - p);
+   }
+   munmap(aligned + HEAP_MAX_SIZE, p + HEAP_MAX_SIZE - aligned);
+
+   if (huge == HUGE_THP && madvise(aligned, HEAP_MAX_SIZE, MADV_HUGEPAGE) != 0)
+   {
+      huge = HUGE_OFF;
+   }
+
+   size_t unit = huge != HUGE_OFF ? HUGE_PAGE_SIZE : page_size;
+
+   struct _heap *h = (struct _heap *)aligned;
+   if (mprotect(h, unit, PROT_READ | PROT_WRITE) != 0)
+   {
+      munmap(h, HEAP_MAX_SIZE);
+      return NULL;
+   }
+
+   h->arena = a;
+   h->prev = a ? a->heap : NULL;
+   h->committed = unit;
+   h->huge = huge;
+
+   return h;
+}
+
+/*
+ * \brief heapStart
+ *
+ * Places the initial fence of a heap right after the given header so
+ * that the first _block grown in the heap has no previous _block.
+ *
+ * \param a the arena the heap belongs to
+ * \param h the heap
+ * \param start first byte after the heap (and arena) header
+ *
+ * \return none
+ */
+static void heapStart(struct _arena *a, struct _heap *h, char *start)
+{
+   struct _block *fence = (struct _block *)(((uintptr_t)start + 15) & ~(uintptr_t)15);
+
+   fence->size = BLOCK_PREV_INUSE;
+
+   a->heap = h;
+   a->heapEnd = fence;
+   a->top = (char *)h + h->committed;
+   a->clean = (char *)BLOCK_DATA(fence);
+}
+
+/*
+ * \brief growStep
+ *
+ * Sizes the next call to the OS for an arena and doubles the step after
+ * it.
+ *
+ * \param a the arena, locked
+ * \param needed bytes the call must at least add
+ *
+ * \return bytes to ask for, a multiple of the page size
+ */
+static size_t growStep(struct _arena *a, size_t needed)
+{
+   size_t step = a->grow_step > grow_min ? a->grow_step : grow_min;
+
+   a->grow_step = step < GROW_STEP_MAX / 2 ? 2 * step : GROW_STEP_MAX;
+
+   needed = (needed + page_size - 1) & ~(page_size - 1);
+   step = (step + page_size - 1) & ~(page_size - 1);
+
+   return needed > step ? needed : step;
+}
+
+/*
+ * \brief sbrkExtend
+ *
+ * Moves the break up to at least end, provided it is still where the
+ * arena left it.
+ *
+ * \param a the main arena, locked
+ * \param end first byte past the memory needed
+ *
+ * \return true if memory up to end is usable
+ */
+static bool sbrkExtend(struct _arena *a, char *end)
+{
+   if (sbrk(0) != a->top)
+   {
+      return false;
+   }
+
+   /* Fall back to just what is needed when the step is too much */
+   size_t increment = growStep(a, end - a->top);
+   if (sbrk(increment) == (void *)-1)
+   {
+      increment = end - a->top;
+      if (sbrk(increment) == (void *)-1)
+      {
+         return false;
+      }
+   }
+
+   a->top += increment;
+   __atomic_store_n(&main_hi, a->top, __ATOMIC_RELAXED);
+
+   a->stats.num_grows++;
+   a->stats.max_heap = a->stats.max_heap + increment;
+
+   return true;
+}
+
+/*
+ * \brief sbrkStart
+ *
+ * Starts a new run of _blocks wherever the break was left, aligned and
+ * with room for the header of the fence.  Any wilderness of the old run
+ * is given up.
+ *
+ * \param a the main arena, locked
+ * \param needed bytes needed past the new fence
+ *
+ * \return true on success, false if the break could not move
+ */
+static bool sbrkStart(struct _arena *a, size_t needed)
+{
+   char *brk = sbrk(0);
+   struct _block *fence = (struct _block *)(brk + (-(uintptr_t)brk & (ALIGNMENT - 1)));
+
+   a->top = brk;
+   if (!sbrkExtend(a, (char *)BLOCK_DATA(fence) + needed))
+   {
+      return false;
+   }
+
+   fence->size = BLOCK_PREV_INUSE;
+   a->heapEnd = fence;
+
+   if (main_lo == NULL)
+   {
+      __atomic_store_n(&main_lo, (char *)fence, __ATOMIC_RELAXED);
+   }
+
+   return true;
+}
+
+/*
+ * \brief sbrkRelease
+ *
+ * Lowers the break to end, rounded up to a page, provided nobody else
+ * moved it.
+ *
+ * \param a the main arena, locked
+ * \param end lowest address to give back from
+ *
+ * \return number of bytes released
+ */
+static size_t sbrkRelease(struct _arena *a, char *end)
+{
+   /* The rest of the last page keeps what was in it */
+   end = (char *)(((uintptr_t)end + page_size - 1) & ~(page_size - 1));
+   if (end >= a->top || sbrk(0) != a->top ||
+       sbrk(-(intptr_t)(a->top - end)) == (void *)-1)
+   {
+      return 0;
+   }
+
+   size_t released = a->top - end;
+   a->top = end;
+   __atomic_store_n(&main_hi, end, __ATOMIC_RELAXED);
+
+   return released;
+}
+
+/*
+ * \brief mmapExtend
+ *
+ * Commits more of the current heap, up to at least end.
+ *
+ * \param a the arena, locked
+ * \param end first byte past the memory needed
+ *
+ * \return true if memory up to end is usable, false if it is past the
+ * end of the heap or mprotect fails
+ */
+static bool mmapExtend(struct _arena *a, char *end)
+{
+   struct _heap *h = a->heap;
+   char *limit = (char *)h + HEAP_MAX_SIZE;
+
+   if (h == NULL || end > limit)
+   {
+      return false;
+   }
+
+   char *want = a->top + growStep(a, end - a->top);
+   if (want > limit)
+   {
+      want = limit;
+   }
+   if (!heapCommit(h, want) && !heapCommit(h, end))
+   {
+      return false;
+   }
+
+   char *top = a->top;
+   a->top = (char *)h + h->committed;
+
+   a->stats.num_grows++;
+   a->stats.max_heap = a->stats.max_heap + (a->top - top);
+
+   return true;
+}
+
+/*
+ * \brief mmapStart
+ *
+ * Reserves a new heap for the arena and commits enough of it.
+ *
+ * \param a the arena, locked
+ * \param needed bytes needed past the new fence
+ *
+ * \return true on success, false if no heap could hold it or be reserved
+ */
+static bool mmapStart(struct _arena *a, size_t needed)
+{
+   /* Too large for any heap, the caller falls back to the main arena */
+   if (needed > HEAP_MAX_SIZE - page_size)
+   {
+      return false;
+   }
+
+   struct _heap *h = heapCreate(a);
+   if (h == NULL)
+   {
+      return false;
+   }
+   heapStart(a, h, (char *)(h + 1));
+
+   a->stats.num_grows++;
+   a->stats.max_heap = a->stats.max_heap + h->committed;
+
+   char *end = (char *)BLOCK_DATA(a->heapEnd) + needed;
+   return end <= a->top || mmapExtend(a, end);
+}
+
+/*
+ * \brief mmapRelease
+ *
+ * Drops the committed pages of the current heap from end up, rounded up
+ * to a commit unit, with a fresh PROT_NONE mapping.
+ *
+ * \param a the arena, locked
+ * \param end lowest address to give back from
+ *
+ * \return number of bytes released
+ */
+static size_t mmapRelease(struct _arena *a, char *end)
+{
+   struct _heap *h = a->heap;
+   size_t unit = heapUnit(h);
+   size_t keep = (end - (char *)h + unit - 1) & ~(unit - 1);
+
+   if (keep >= h->committed ||
+       mmap((char *)h + keep, h->committed - keep, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED |
+            (h->huge == HUGE_TLB ? MAP_HUGETLB : MAP_NORESERVE),
+            -1, 0) == MAP_FAILED)
+   {
+      return 0;
+   }
+   if (h->huge == HUGE_THP)
+   {
+      /* The new mapping does not inherit the advice */
+      madvise((char *)h + keep, h->committed - keep, MADV_HUGEPAGE);
+   }
+
+   size_t released = h->committed - keep;
+   h->committed = keep;
+   a->top = (char *)h + keep;
+
+   return released;
+}
+
+static const struct _pages page_sources[] =
+{
+   [PAGES_SBRK] = { "sbrk", sbrkExtend, sbrkStart, sbrkRelease },
+   [PAGES_MMAP] = { "mmap", mmapExtend, mmapStart, mmapRelease },
+};
+
+/*
+ * \brief arenaCreate
+ *
+ * Builds a secondary arena inside its own first heap.
+ *
+ * \param index position of the arena in arenas[]
+ *
+ * \return the new arena or NULL if no heap could be reserved
+ */
+static struct _arena *arenaCreate(int index)
+{
+   struct _heap *h = heapCreate(NULL);
+   if (h == NULL)
+   {
+      return NULL;
+   }
+
+   /* The heap is fresh from mmap, so the arena starts zeroed */
+   struct _arena *a = (struct _arena *)(h + 1);
+   pthread_mutex_init(&a->lock, NULL);
+   a->index = index;
+   a->pages = &page_sources[PAGES_MMAP];
+   h->arena = a;
+
+   heapStart(a, h, (char *)(a + 1));
+
+   return a;
+}
+
+/*
+ * \brief arenaGet
+ *
+ * \param index position in arenas[], below num_arenas
+ *
+ * \return the arena at index, created on first use, or the main arena if
+ * it could not be created
+ */
+static struct _arena *arenaGet(int index)
+{
+   struct _arena *a = __atomic_load_n(&arenas[index], __ATOMIC_ACQUIRE);
+
+   if (a == NULL)
+   {
+      pthread_mutex_lock(&arenas_lock);
+      a = arenas[index];
+      if (a == NULL)
+      {
+         a = arenaCreate(index);
+         if (a)
+         {
+            __atomic_store_n(&arenas[index], a, __ATOMIC_RELEASE);
+         }
+      }
+      pthread_mutex_unlock(&arenas_lock);
+   }
+
+   return a ? a : &main_arena;
+}
+
+/*
+ * \brief arenaLock
+ *
+ * Locks an arena for the calling thread.  A thread starts on the arena of
+ * the CPU it runs on, or the next one round robin if the CPU is unknown.
+ * When that arena is busy it moves to the first one that is not.  Objects
+ * other threads freed into the arena meanwhile are taken back first.
+ *
+ * \return the locked arena
+ */
+static struct _arena *arenaLock(void)
+{
+   struct _arena *a = thread_arena;
+
+   if (a == NULL)
+   {
+      int cpu = sched_getcpu();
+      unsigned int i = cpu >= 0 ? (unsigned int)cpu
+                                : __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+      a = thread_arena = arenaGet(i % num_arenas);
+   }
+
+   if (pthread_mutex_trylock(&a->lock) == 0)
+   {
+      remoteDrain(a);
+      return a;
+   }
+
+   for (int i = 1; i < num_arenas; i++)
+   {
+      struct _arena *other = arenaGet((a->index + i) % num_arenas);
+      if (other != a && pthread_mutex_trylock(&other->lock) == 0)
+      {
+         thread_arena = other;
+         remoteDrain(other);
+         return other;
+      }
+   }
+
+   pthread_mutex_lock(&a->lock);
+   remoteDrain(a);
+   return a;
+}
+
+/*
+ * \brief arenaOf
+ *
+ * \param b a _block
+ *
+ * \return the arena the _block belongs to
+ */
+static inline struct _arena *arenaOf(struct _block *b)
+{
+   char *p = (char *)b;
+
+   if (p >= __atomic_load_n(&main_lo, __ATOMIC_RELAXED) &&
+       p <  __atomic_load_n(&main_hi, __ATOMIC_RELAXED))
+   {
+      return &main_arena;
+   }
+
+   return HEAP_OF(b)->arena;
+}
+
+/*
+ * \brief growheap
+ *
+ * Carves a new _block out of the wilderness past the fence of an arena.
+ * When the wilderness is too small, the arena's page source first
+ * extends it by growStep() bytes, or failing that starts a new run of
+ * _blocks, and the new _block takes the place of the fence.
+ *
+ * \param a the arena to grow
+ * \param size size in bytes of the new _block
+ *
+ * \return returns the newly allocated _block of NULL if failed
+ */
+struct _block *growHeap(struct _arena *a, size_t size)
+{
+   size_t needed = BLOCK_OVERHEAD + size;
+   char *end = a->heapEnd ? (char *)BLOCK_DATA(a->heapEnd) + needed : NULL;
+
+   if (end == NULL || end > a->top)
+   {
+      if (!(end && a->pages->extend(a, end)) && !a->pages->start(a, needed))
+      {
+         /* The break is stuck, so the main arena carries on in heaps */
+         if (a->pages != &page_sources[PAGES_SBRK] ||
+             !page_sources[PAGES_MMAP].start(a, needed))
+         {
+            return NULL;
+         }
+         a->pages = &page_sources[PAGES_MMAP];
+      }
+   }
+   else
+   {
+      a->stats.num_carves++;
+   }
+
+   /* Update _block metadata:
+      Set the size of the new block and mark it in use.  The old fence's
+      prev_size is part of the previous _block and stays as it is.
+   */
+   struct _block *curr = a->heapEnd;
+   curr->size = size | (curr->size & BLOCK_PREV_INUSE);
+
+   a->heapEnd = BLOCK_NEXT(curr);
+   a->heapEnd->size = BLOCK_PREV_INUSE;
+   if ((char *)BLOCK_DATA(a->heapEnd) > a->clean)
+   {
+      a->clean = (char *)BLOCK_DATA(a->heapEnd);
+   }
+
+   a->stats.num_blocks++;
+
+   return curr;
+}
+
+/*
+ * \brief coalesce
+ *
+ * Merges a free _block with its free neighbours in memory and puts the
+ * result on its free list.  Runs in constant time thanks to the
+ * boundary tags.
+ *
+ * \param a the arena owning the _block, locked
+ * \param curr the _block that just became free
+ *
+ * \return the merged _block
+ */
+static struct _block *coalesce(struct _arena *a, struct _block *curr)
+{
+   struct _block *next = BLOCK_NEXT(curr);
+
+   if (BLOCK_IS_FREE(next))
+   {
+      freeListRemove(a, next);
+      curr->size += BLOCK_OVERHEAD + BLOCK_SIZE(next);
+
+      a->stats.num_coalesces++;
+      a->stats.num_blocks--;
+   }
+
+   if (!(curr->size & BLOCK_PREV_INUSE))
+   {
+      struct _block *prev = BLOCK_PREV(curr);
+
+      freeListRemove(a, prev);
+      prev->size += BLOCK_OVERHEAD + BLOCK_SIZE(curr);
+      curr = prev;
+
+      a->stats.num_coalesces++;
+      a->stats.num_blocks--;
+   }
+
+   curr->size |= BLOCK_FREE;
+   next = BLOCK_NEXT(curr);
+   next->prev_size = BLOCK_SIZE(curr);
+   next->size &= ~BLOCK_PREV_INUSE;
+   freeListInsert(a, curr);
+
+   return curr;
+}
+
+/*
+ * \brief splitBlock
+ *
+ * Shrinks a _block to size bytes and frees the remainder.
+ *
+ * \param a the arena owning the _block, locked
+ * \param curr the _block to split
+ * \param size new size of curr in bytes
+ *
+ * \return none
+ */
+static void splitBlock(struct _arena *a, struct _block *curr, size_t size)
+{
+   struct _block *split = (struct _block *)((char *)curr + BLOCK_OVERHEAD + size);
+
+   split->size = (BLOCK_SIZE(curr) - size - BLOCK_OVERHEAD) | BLOCK_PREV_INUSE;
+   curr->size = size | (curr->size & BLOCK_FLAGS);
+
+   a->stats.num_splits++;
+   a->stats.num_blocks++;
+
+   coalesce(a, split);
+}
+
+/*
+ * \brief heapTrim
+ *
+ * Gives the wilderness of an arena back to its page source, along with
+ * the free _block at its end, which becomes part of the wilderness,
+ * keeping pad bytes past the fence.  The next growth starts again at
+ * grow_min.
+ *
+ * \param a the arena, locked
+ * \param pad bytes of wilderness to keep
+ *
+ * \return number of bytes released
+ */
+static size_t heapTrim(struct _arena *a, size_t pad)
+{
+   if (a->heapEnd == NULL)
+   {
+      return 0;
+   }
+
+   struct _block *fence = a->heapEnd;
+   struct _block *top = NULL;
+   if (!(fence->size & BLOCK_PREV_INUSE))
+   {
+      top = fence = BLOCK_PREV(fence);
+   }
+
+   char *end = (char *)BLOCK_DATA(fence) + pad;
+   if (end + page_size > a->top)
+   {
+      return 0;
+   }
+
+   /* The free list links and tree node of top may lie past the new end */
+   if (top)
+   {
+      freeListRemove(a, top);
+   }
+
+   size_t released = a->pages->release(a, end);
+   if (released == 0)
+   {
+      if (top)
+      {
+         freeListInsert(a, top);
+      }
+      return 0;
+   }
+
+   if (top)
+   {
+      top->size &= BLOCK_PREV_INUSE;
+      a->heapEnd = top;
+      a->stats.num_blocks--;
+   }
+
+   if (a->clean > a->top)
+   {
+      a->clean = a->top;
+   }
+   a->grow_step = 0;
+
+   a->stats.num_trimmed += released;
+
+   return released;
+}
+
+/*
+ * \brief maybeTrim
+ *
+ * Trims the arena when a freshly freed _block at its end has reached the
+ * trim threshold, keeping a grow_min step of wilderness for what comes
+ * next.
+ *
+ * \param a the arena, locked
+ * \param b the _block coalesce() returned
+ *
+ * \return none
+ */
+static inline void maybeTrim(struct _arena *a, struct _block *b)
+{
+   if (BLOCK_NEXT(b) == a->heapEnd &&
+       BLOCK_SIZE(b) >= __atomic_load_n(&trim_threshold, __ATOMIC_RELAXED))
+   {
+      heapTrim(a, grow_min);
+   }
+}
+
+/*
+ * \brief heapAlloc
+ *
+ * Takes a _block of at least size bytes from the free lists, or from the
+ * OS if none fits, and splits off what is left over.
+ *
+ * \param a the arena to allocate from, locked
+ * \param size aligned size of the _block in bytes
+ *
+ * \return the _block, marked in use, or NULL if the heap could not grow
+ */
+static struct _block *heapAlloc(struct _arena *a, size_t size)
+{
+   /* Look for free _block.  If a free block isn't found then we need to grow our heap. */
+
+   if (size < BLOCK_MIN)
+   {
+      size = BLOCK_MIN;
+   }
+
+   struct _block *next = findFreeBlock(a, size);
+
+   /* Could not find free _block, so grow heap */
+   if (next == NULL) 
+   {
+      char *clean = a->clean;
+      next = growHeap(a, size);
+      lat_path = PATH_GROW;
+
+      /* Only what lay above the clean mark before is still zero */
+      fresh_from = NULL;
+      if (next)
+      {
+         char *data = (char *)BLOCK_DATA(next);
+         fresh_from = clean > data ? clean : data;
+      }
+   }
+   else
+   {
+      freeListRemove(a, next);
+      lat_path = PATH_REUSE;
+      fresh_from = NULL;
+   }
+
+   /* Could not find free _block or grow heap, so just return NULL */
+   if (next == NULL) 
+   {
+      return NULL;
+   }
+
+   /* Mark _block as in use */
+   next->size &= ~BLOCK_FREE;
+   BLOCK_NEXT(next)->size |= BLOCK_PREV_INUSE;
+
+   /* If the leftover space can hold a free _block, split it off */
+   if (BLOCK_SIZE(next) >= size + BLOCK_OVERHEAD + BLOCK_MIN)
+   {
+      splitBlock(a, next, size);
+      lat_path = PATH_SPLIT;
+   }
+
+   // added reuses
+   else if(BLOCK_SIZE(next) >= size)
+   {
+      a->stats.num_reuses++;
+   }
+
+   if (fresh_from >= (char *)BLOCK_NEXT(next))
+   {
+      fresh_from = NULL;
+   }
+
+   return next;
+}
+
+/*
+ * \brief growInPlace
+ *
+ * Grows an in use _block without moving it, first by absorbing a free
+ * _block behind it and then, if it ends up at the top of the arena, by
+ * growing the heap right behind it.  Anything left over past size is
+ * split off again.
+ *
+ * \param a the arena owning the _block, locked
+ * \param curr the _block to grow
+ * \param size new size of curr in bytes
+ *
+ * \return true if curr now holds at least size bytes
+ */
+static bool growInPlace(struct _arena *a, struct _block *curr, size_t size)
+{
+   struct _block *next = BLOCK_NEXT(curr);
+
+   if (BLOCK_IS_FREE(next))
+   {
+      freeListRemove(a, next);
+      curr->size += BLOCK_OVERHEAD + BLOCK_SIZE(next);
+      next = BLOCK_NEXT(curr);
+      next->size |= BLOCK_PREV_INUSE;
+
+      a->stats.num_coalesces++;
+      a->stats.num_blocks--;
+   }
+
+   if (BLOCK_SIZE(curr) < size)
+   {
+      /* The heap only grows right behind the fence if the wilderness
+         has room or the page source can extend it.  The old fence's
+         header becomes part of curr. */
+      size_t more = size - BLOCK_SIZE(curr) - BLOCK_OVERHEAD;
+      char *end = (char *)BLOCK_DATA(next) + more + BLOCK_OVERHEAD;
+
+      if (next != a->heapEnd ||
+          (end > a->top && !a->pages->extend(a, end)) ||
+          growHeap(a, more) != next)
+      {
+         return false;
+      }
+
+      curr->size += BLOCK_OVERHEAD + more;
+
+      a->stats.num_blocks--;
+   }
+
+   if (BLOCK_SIZE(curr) - size >= BLOCK_OVERHEAD + BLOCK_MIN)
+   {
+      splitBlock(a, curr, size);
+   }
+
+   return true;
+}
+
+/*
+ * \brief mmapAlloc
+ *
+ * Serves a large request with its own anonymous mapping.  The _block
+ * header sits at the start of the mapping and the size covers the whole
+ * rest of it.  The prev_size of a mapped _block, which has no previous
+ * _block, holds its offset into the mapping instead: 0 here, more for
+ * the _blocks of mmapAligned().
+ *
+ * \param size aligned size of the request in bytes
+ *
+ * \return the mapped _block or NULL if mmap failed
+ */
+static struct _block *mmapAlloc(size_t size)
+{
+   size_t length = (HEADER_SIZE + size + page_size - 1) & ~(page_size - 1);
+
+   if (length < size)
+   {
+      return NULL;
+   }
+
+   struct _block *b = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (b == MAP_FAILED)
+   {
+      return NULL;
+   }
+
+   b->prev_size = 0;
+   b->size = (length - HEADER_SIZE) | BLOCK_MMAPPED | BLOCK_PREV_INUSE;
+
+   return b;
+}
+
+/*
+ * \brief mmapAligned
+ *
+ * Maps a _block whose data is aligned to more than ALIGNMENT.  The
+ * mapping is overallocated and the whole pages on either side of the
+ * aligned _block are unmapped again.
+ *
+ * \param alignment a power of two above ALIGNMENT
+ * \param size aligned size of the request in bytes
+ *
+ * \return the mapped _block or NULL if mmap failed
+ */
+static struct _block *mmapAligned(size_t alignment, size_t size)
+{
+   size_t length = (HEADER_SIZE + size + alignment + page_size - 1) & ~(page_size - 1);
+
+   if (length < size)
+   {
+      return NULL;
+   }
+
+   char *base = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (base == MAP_FAILED)
+   {
+      return NULL;
+   }
+
+   char *data = (char *)(((uintptr_t)base + HEADER_SIZE + alignment - 1) & ~(alignment - 1));
+   char *lead = (char *)((uintptr_t)(data - HEADER_SIZE) & ~(page_size - 1));
+   char *end = (char *)(((uintptr_t)data + size + page_size - 1) & ~(page_size - 1));
+
+   if (lead > base)
+   {
+      munmap(base, lead - base);
+   }
+   if (end < base + length)
+   {
+      munmap(end, base + length - end);
+   }
+
+   struct _block *b = BLOCK_HEADER(data);
+   b->prev_size = (char *)b - lead;
+   b->size = (end - data) | BLOCK_MMAPPED | BLOCK_PREV_INUSE;
+
+   return b;
+}
+
+/*
+ * \brief mmapFree
+ *
+ * Unmaps a mapped _block and adjusts the dynamic mmap threshold.
+ *
+ * \param b the mapped _block
+ *
+ * \return none
+ */
+static void mmapFree(struct _block *b)
+{
+   size_t size = BLOCK_SIZE(b);
+
+   if (!__atomic_load_n(&mmap_threshold_fixed, __ATOMIC_RELAXED) &&
+       size > __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+       size <= MMAP_THRESHOLD_MAX)
+   {
+      __atomic_store_n(&mmap_threshold, size, __ATOMIC_RELAXED);
+      if (!__atomic_load_n(&trim_threshold_fixed, __ATOMIC_RELAXED))
+      {
+         __atomic_store_n(&trim_threshold, 2 * size, __ATOMIC_RELAXED);
+      }
+   }
+
+   munmap((char *)b - b->prev_size, BLOCK_MAPPING(b));
+}
+
+/*
+ * \brief mmapResize
+ *
+ * Resizes a mapped _block with mremap(), which moves the pages instead
+ * of copying them if the mapping cannot grow where it is.
+ *
+ * \param b the mapped _block
+ * \param size new aligned size in bytes
+ *
+ * \return the resized _block, possibly at a new address, or NULL
+ */
+static struct _block *mmapResize(struct _block *b, size_t size)
+{
+   size_t offset = b->prev_size;
+   size_t length = (offset + HEADER_SIZE + size + page_size - 1) & ~(page_size - 1);
+
+   if (length < size)
+   {
+      return NULL;
+   }
+
+   char *base = mremap((char *)b - offset, BLOCK_MAPPING(b), length, MREMAP_MAYMOVE);
+   if (base == MAP_FAILED)
+   {
+      return NULL;
+   }
+
+   struct _block *n = (struct _block *)(base + offset);
+   n->size = (length - offset - HEADER_SIZE) | BLOCK_MMAPPED | BLOCK_PREV_INUSE;
+
+   return n;
+}
+
+/*
+ * \brief isSlab
+ *
+ * \param p a pointer handed out by malloc
+ *
+ * \return true if p is a slab object rather than the data of a _block
+ */
+static inline bool isSlab(void *p)
+{
+   char *lo = __atomic_load_n(&slab_lo, __ATOMIC_ACQUIRE);
+
+   return lo && (uintptr_t)((char *)p - lo) < SLAB_REGION_SIZE;
+}
+
+/*
+ * \brief slabCreate
+ *
+ * Sets up an empty slab for one class, reusing a slab given back earlier
+ * or taking the next one from the region, which is reserved on the first
+ * call and committed SLAB_COMMIT bytes at a time.
+ *
+ * \param a the arena the slab is for, locked
+ * \param c the small class of its objects
+ *
+ * \return the new slab, already on the arena's list, or NULL if the
+ * region is used up
+ */
+static struct _slab *slabCreate(struct _arena *a, int c)
+{
+   pthread_mutex_lock(&slab_lock);
+
+   if (slab_lo == NULL)
+   {
+      char *p = mmap(NULL, SLAB_REGION_SIZE, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED)
+      {
+         pthread_mutex_unlock(&slab_lock);
+         return NULL;
+      }
+      slab_next = slab_committed = p;
+      __atomic_store_n(&slab_lo, p, __ATOMIC_RELEASE);
+   }
+
+   struct _slab *s = slab_free;
+   if (s)
+   {
+      slab_free = s->next;
+   }
+   else if (slab_num_dropped > 0)
+   {
+      /* The page of a dropped slab comes back zeroed on first touch */
+      while (slab_dropped[slab_drop_hint] == 0)
+      {
+         slab_drop_hint++;
+      }
+
+      size_t index = slab_drop_hint * 64 + __builtin_ctzll(slab_dropped[slab_drop_hint]);
+      slab_dropped[slab_drop_hint] &= slab_dropped[slab_drop_hint] - 1;
+      slab_num_dropped--;
+      s = (struct _slab *)(slab_lo + index * SLAB_SIZE);
+   }
+   else
+   {
+      if (slab_next == slab_committed)
+      {
+         if (slab_committed == slab_lo + SLAB_REGION_SIZE ||
+             mprotect(slab_committed, SLAB_COMMIT, PROT_READ | PROT_WRITE) != 0)
+         {
+            pthread_mutex_unlock(&slab_lock);
+            return NULL;
+         }
+         slab_committed += SLAB_COMMIT;
+      }
+      s = (struct _slab *)slab_next;
+      slab_next += SLAB_SIZE;
+   }
+
+   pthread_mutex_unlock(&slab_lock);
+
+   s->arena = a;
+   s->class = c;
+   s->size = class_size[c] < SLAB_MIN_SLOT ? SLAB_MIN_SLOT : class_size[c];
+   s->total = ((char *)s + SLAB_SIZE - SLAB_DATA(s)) / s->size;
+   s->used = 0;
+   s->hint = 0;
+
+   memset(s->map, 0, sizeof(s->map));
+   for (int i = 0; i < s->total / 64; i++)
+   {
+      s->map[i] = ~0ULL;
+   }
+   if (s->total % 64)
+   {
+      s->map[s->total / 64] = (1ULL << (s->total % 64)) - 1;
+   }
+
+   s->prev = NULL;
+   s->next = a->slabs[c];
+   if (s->next)
+   {
+      s->next->prev = s;
+   }
+   a->slabs[c] = s;
+
+   a->stats.num_slabs++;
+
+   return s;
+}
+
+/*
+ * \brief slabUnlink
+ *
+ * Takes a slab off its arena's list of slabs with free slots.
+ *
+ * \param a the arena owning the slab, locked
+ * \param s the slab
+ *
+ * \return none
+ */
+static void slabUnlink(struct _arena *a, struct _slab *s)
+{
+   if (s->prev)
+   {
+      s->prev->next = s->next;
+   }
+   else
+   {
+      a->slabs[s->class] = s->next;
+   }
+
+   if (s->next)
+   {
+      s->next->prev = s->prev;
+   }
+}
+
+/*
+ * \brief slabAlloc
+ *
+ * Takes the first free slot of the first slab of a class with one,
+ * setting up a new slab if there is none.
+ *
+ * \param a the arena to allocate from, locked
+ * \param c the small class
+ *
+ * \return the object or NULL if no slab could be set up
+ */
+static void *slabAlloc(struct _arena *a, int c)
+{
+   struct _slab *s = a->slabs[c];
+
+   lat_path = PATH_SLAB;
+
+   if (s == NULL && (s = slabCreate(a, c)) == NULL)
+   {
+      return NULL;
+   }
+
+   while (s->map[s->hint] == 0)
+   {
+      s->hint++;
+   }
+
+   int slot = s->hint * 64 + __builtin_ctzll(s->map[s->hint]);
+   s->map[s->hint] &= s->map[s->hint] - 1;
+
+   if (++s->used == s->total)
+   {
+      slabUnlink(a, s);
+   }
+
+   return SLAB_DATA(s) + (size_t)slot * s->size;
+}
+
+/*
+ * \brief slabFree
+ *
+ * Marks the slot of an object free.  A slab that was full goes back on
+ * its arena's list.  One that becomes empty is given back to the region
+ * for any class and arena to reuse, unless it is the last slab of its
+ * class with free slots.
+ *
+ * \param a the arena owning the slab, locked
+ * \param p the object
+ *
+ * \return none
+ */
+static void slabFree(struct _arena *a, void *p)
+{
+   struct _slab *s = SLAB_OF(p);
+   size_t slot = ((char *)p - SLAB_DATA(s)) / s->size;
+
+   assert((s->map[slot / 64] & (1ULL << (slot % 64))) == 0);
+   s->map[slot / 64] |= 1ULL << (slot % 64);
+   if (slot / 64 < s->hint)
+   {
+      s->hint = slot / 64;
+   }
+
+   if (s->used-- == s->total)
+   {
+      s->prev = NULL;
+      s->next = a->slabs[s->class];
+      if (s->next)
+      {
+         s->next->prev = s;
+      }
+      a->slabs[s->class] = s;
+   }
+   else if (s->used == 0 && (a->slabs[s->class] != s || s->next))
+   {
+      slabUnlink(a, s);
+
+      pthread_mutex_lock(&slab_lock);
+      s->next = slab_free;
+      slab_free = s;
+      pthread_mutex_unlock(&slab_lock);
+   }
+}
+
+/*
+ * \brief tcacheNext
+ *
+ * \param p a cached object
+ *
+ * \return where the link to the next object in the bin is kept: the
+ * first word, which is next_free for a _block
+ */
+static inline void **tcacheNext(void *p)
+{
+   return (void **)p;
+}
+
+/*
+ * Remote frees.  A thread that frees an object of an arena other than its
+ * own does not wait for that arena's lock: it pushes the object onto the
+ * arena's remote list with a compare and swap, linked through its first
+ * word like in the thread cache.  The next thread to lock the arena
+ * through arenaLock() swaps the whole list out in one go and frees it.
+ * Pushes never remove anything and the list is only ever taken whole, so
+ * there is no ABA problem.
+ */
+
+/*
+ * \brief remotePush
+ *
+ * \param a the arena owning the objects, not locked
+ * \param first first object of a chain linked with tcacheNext()
+ * \param last last object of the chain
+ *
+ * \return none
+ */
+static void remotePush(struct _arena *a, void *first, void *last)
+{
+   void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+   do
+   {
+      *tcacheNext(last) = head;
+   } while (!__atomic_compare_exchange_n(&a->remote, &head, first, true,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * \brief remoteDrain
+ *
+ * Frees everything other threads pushed onto an arena's remote list.
+ *
+ * \param a the arena, locked
+ *
+ * \return none
+ */
+static void remoteDrain(struct _arena *a)
+{
+   if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == NULL)
+   {
+      return;
+   }
+
+   void *p = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE);
+   while (p)
+   {
+      void *next = *tcacheNext(p);
+
+      if (isSlab(p))
+      {
+         slabFree(a, p);
+      }
+      else
+      {
+         maybeTrim(a, coalesce(a, BLOCK_HEADER(p)));
+      }
+
+      p = next;
+   }
+}
+
+/*
+ * \brief tcacheRefill
+ *
+ * Moves TCACHE_FILL objects of one class from the thread's arena into
+ * the cache.
+ *
+ * \param tc the calling thread's cache
+ * \param c the small class to refill
+ *
+ * \return none
+ */
+static void tcacheRefill(struct _tcache *tc, int c)
+{
+   struct _arena *a = arenaLock();
+
+   while (tc->count[c] < TCACHE_FILL)
+   {
+      void *p;
+      if (use_slabs)
+      {
+         p = slabAlloc(a, c);
+      }
+      else
+      {
+         struct _block *b = heapAlloc(a, class_size[c] - BLOCK_OVERHEAD);
+         p = b ? BLOCK_DATA(b) : NULL;
+      }
+
+      if (p == NULL)
+      {
+         break;
+      }
+
+      *tcacheNext(p) = tc->bins[c];
+      tc->bins[c] = p;
+      tc->count[c]++;
+   }
+
+   pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * \brief tcacheFlush
+ *
+ * Returns cached objects of one class to the arenas they came from,
+ * coalescing each _block.  Consecutive objects of the same arena share
+ * one lock acquisition, or one push onto its remote list when it is not
+ * the thread's own arena.
+ *
+ * \param tc the calling thread's cache
+ * \param c the small class to flush
+ * \param keep number of _blocks to leave in the cache
+ *
+ * \return none
+ */
+static void tcacheFlush(struct _tcache *tc, int c, unsigned int keep)
+{
+   struct _arena *locked = NULL;
+   struct _arena *remote = NULL;
+   void *first = NULL;
+   void *last = NULL;
+
+   while (tc->count[c] > keep)
+   {
+      void *p = tc->bins[c];
+      tc->bins[c] = *tcacheNext(p);
+      tc->count[c]--;
+
+      struct _arena *a = use_slabs ? SLAB_OF(p)->arena : arenaOf(BLOCK_HEADER(p));
+      if (a != thread_arena)
+      {
+         if (a != remote)
+         {
+            if (remote)
+            {
+               remotePush(remote, first, last);
+            }
+            remote = a;
+            first = p;
+         }
+         else
+         {
+            *tcacheNext(last) = p;
+         }
+         last = p;
+
+         TCACHE_COUNT(tc, num_remote, 1);
+         continue;
+      }
+
+      if (a != locked)
+      {
+         if (locked)
+         {
+            pthread_mutex_unlock(&locked->lock);
+         }
+         pthread_mutex_lock(&a->lock);
+         locked = a;
+      }
+
+      if (use_slabs)
+      {
+         slabFree(a, p);
+      }
+      else
+      {
+         maybeTrim(a, coalesce(a, BLOCK_HEADER(p)));
+      }
+   }
+
+   if (remote)
+   {
+      remotePush(remote, first, last);
+   }
+
+   if (locked)
+   {
+      pthread_mutex_unlock(&locked->lock);
+   }
+}
+
+/*
+ * \brief tcacheDestroy
+ *
+ * Thread exit destructor.  Gives every cached object back to its arena
+ * and sends later calls from this thread straight to the heap.
+ *
+ * \param arg the exiting thread's cache
+ *
+ * \return none
+ */
+static void tcacheDestroy(void *arg)
+{
+   struct _tcache *tc = arg;
+
+   tc->disabled = true;
+   for (int c = 0; c < NUM_SMALL_CLASSES; c++)
+   {
+      tcacheFlush(tc, c, 0);
+   }
+
+   pthread_mutex_lock(&tcache_lock);
+   countersAdd(&tcache_exited, &tc->stats);
+   if (tc->prev)
+   {
+      tc->prev->next = tc->next;
+   }
+   else
+   {
+      tcache_list = tc->next;
+   }
+   if (tc->next)
+   {
+      tc->next->prev = tc->prev;
+   }
+   pthread_mutex_unlock(&tcache_lock);
+}
+
+/*
+ * \brief tcacheGet
+ *
+ * \return the calling thread's cache, or NULL once the thread is exiting
+ */
+static inline struct _tcache *tcacheGet(void)
+{
+   struct _tcache *tc = &tcache;
+
+   if (tc->disabled)
+   {
+      return NULL;
+   }
+
+   if (!tc->registered)
+   {
+      /* A non-NULL value makes tcacheDestroy run at thread exit */
+      tc->registered = true;
+      pthread_setspecific(tcache_key, tc);
+
+      pthread_mutex_lock(&tcache_lock);
+      tc->prev = NULL;
+      tc->next = tcache_list;
+      if (tc->next)
+      {
+         tc->next->prev = tc;
+      }
+      tcache_list = tc;
+      pthread_mutex_unlock(&tcache_lock);
+   }
+
+   return tc;
+}
+
+/* Hold every arena lock across fork() so the child gets consistent heaps */
+static void forkPrepare(void)
+{
+   pthread_mutex_lock(&arenas_lock);
+   for (int i = 0; i < num_arenas; i++)
+   {
+      if (arenas[i])
+      {
+         pthread_mutex_lock(&arenas[i]->lock);
+      }
+   }
+   pthread_mutex_lock(&slab_lock);
+   pthread_mutex_lock(&tcache_lock);
+}
+
+static void forkParent(void)
+{
+   pthread_mutex_unlock(&tcache_lock);
+   pthread_mutex_unlock(&slab_lock);
+   for (int i = 0; i < num_arenas; i++)
+   {
+      if (arenas[i])
+      {
+         pthread_mutex_unlock(&arenas[i]->lock);
+      }
+   }
+   pthread_mutex_unlock(&arenas_lock);
+}
+
+static void forkChild(void)
+{
+   for (int i = 0; i < num_arenas; i++)
+   {
+      if (arenas[i])
+      {
+         pthread_mutex_init(&arenas[i]->lock, NULL);
+      }
+   }
+   pthread_mutex_init(&tcache_lock, NULL);
+   pthread_mutex_init(&slab_lock, NULL);
+   pthread_mutex_init(&arenas_lock, NULL);
+
+   /* The child would log addresses that clash with the parent's into the
+      same file */
+   trace_on = false;
+   hooked = latency_on;
+}
+
+/*
+ * \brief mallocInit
+ *
+ * One time setup on the first call into the allocator.  The number of
+ * arenas comes from MALLOC_ARENAS and defaults to the number of CPUs the
+ * process may run on.  MALLOC_MMAP_THRESHOLD and MALLOC_TRIM_THRESHOLD
+ * fix the mmap and trim thresholds in bytes and MALLOC_GROW_STEP the
+ * smallest step the heaps grow by, MALLOC_POLICY names the placement
+ * policy, MALLOC_PAGES the page source of the main arena, MALLOC_SLABS
+ * turns slabs on or off, MALLOC_STATS the statistics at exit,
+ * MALLOC_LATENCY the latency histograms, MALLOC_TRACE the trace file
+ * and MALLOC_HUGEPAGES huge page heaps.  The
+ * key is created before other threads are let through, while atexit()
+ * and pthread_atfork() run afterwards because they may call malloc.
+ *
+ * \return none
+ */
+static inline void mallocInit(void)
+{
+   if (__atomic_load_n(&atexit_registered, __ATOMIC_ACQUIRE) == 2)
+   {
+      return;
+   }
+
+   int expected = 0;
+   if (!__atomic_compare_exchange_n(&atexit_registered, &expected, 1, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+   {
+      while (__atomic_load_n(&atexit_registered, __ATOMIC_ACQUIRE) != 2)
+      {
+         sched_yield();
+      }
+      return;
+   }
+
+   page_size = sysconf(_SC_PAGESIZE);
+
+   cpu_set_t cpus;
+   int count = 1;
+   if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+   {
+      count = CPU_COUNT(&cpus);
+   }
+
+   const char *env = getenv("MALLOC_ARENAS");
+   if (env && atoi(env) > 0)
+   {
+      count = atoi(env);
+   }
+   num_arenas = count < 1 ? 1 : count > MAX_ARENAS ? MAX_ARENAS : count;
+
+   env = getenv("MALLOC_POLICY");
+   for (size_t i = 0; env && i < sizeof(policies) / sizeof(policies[0]); i++)
+   {
+      if (strcmp(env, policies[i].name) == 0)
+      {
+         policy = &policies[i];
+      }
+   }
+
+   env = getenv("MALLOC_SLABS");
+   if (env && *env)
+   {
+      use_slabs = atoi(env) != 0;
+   }
+
+   env = getenv("MALLOC_STATS");
+   if (env && *env)
+   {
+      print_stats = atoi(env) != 0;
+   }
+
+   env = getenv("MALLOC_LATENCY");
+   if (env && atoi(env) != 0)
+   {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      lat_start_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+      lat_start_ticks = latencyTicks();
+      latency_on = true;
+   }
+
+   env = getenv("MALLOC_TRACE");
+   if (env && *env)
+   {
+      const char *bytes = getenv("MALLOC_TRACE_SIZE");
+      trace_on = traceOpen(env, bytes && *bytes ? strtoul(bytes, NULL, 0) : TRACE_SIZE);
+   }
+   hooked = latency_on || trace_on;
+
+   env = getenv("MALLOC_MMAP_THRESHOLD");
+   if (env && *env)
+   {
+      mmap_threshold = strtoul(env, NULL, 0);
+      mmap_threshold_fixed = true;
+   }
+
+   env = getenv("MALLOC_TRIM_THRESHOLD");
+   if (env && *env)
+   {
+      trim_threshold = strtoul(env, NULL, 0);
+      trim_threshold_fixed = true;
+   }
+
+   env = getenv("MALLOC_GROW_STEP");
+   if (env && *env)
+   {
+      grow_min = strtoul(env, NULL, 0);
+   }
+
+   env = getenv("MALLOC_HUGEPAGES");
+   if (env && (strcmp(env, "thp") == 0 || strcmp(env, "1") == 0))
+   {
+      huge_pages = HUGE_THP;
+   }
+   else if (env && strcmp(env, "hugetlb") == 0)
+   {
+      huge_pages = HUGE_TLB;
+   }
+
+   /* Huge pages only come in heaps */
+   main_arena.pages = &page_sources[huge_pages != HUGE_OFF ? PAGES_MMAP : PAGES_SBRK];
+   env = huge_pages == HUGE_OFF ? getenv("MALLOC_PAGES") : NULL;
+   for (size_t i = 0; env && i < sizeof(page_sources) / sizeof(page_sources[0]); i++)
+   {
+      if (strcmp(env, page_sources[i].name) == 0)
+      {
+         main_arena.pages = &page_sources[i];
+      }
+   }
+
+   pthread_key_create(&tcache_key, tcacheDestroy);
+   __atomic_store_n(&atexit_registered, 2, __ATOMIC_RELEASE);
+
+   pthread_atfork(forkPrepare, forkParent, forkChild);
+   if (print_stats)
+   {
+      atexit( printStatistics );
+   }
+   if (latency_on)
+   {
+      atexit( printLatency );
+   }
+}
+
+/*
+ * \brief mmapMalloc
+ *
+ * Gives a request a mapping of its own and counts it.
+ *
+ * \param size size of the _block in bytes
+ *
+ * \return the zero filled memory or NULL if mmap failed
+ */
+static void *mmapMalloc(size_t size)
+{
+   struct _block *b = mmapAlloc(size);
+   if (b == NULL)
+   {
+      return NULL;
+   }
+
+   lat_path = PATH_MMAP;
+
+   struct _arena *a = arenaLock();
+   a->stats.num_mmaps++;
+   a->stats.num_mallocs++;
+   a->stats.num_requested += size;
+   a->stats.mapped++;
+   a->stats.mapped_bytes += BLOCK_MAPPING(b);
+   pthread_mutex_unlock(&a->lock);
+
+   return BLOCK_DATA(b);
+}
+
+/*
+ * \brief mallocImpl
+ *
+ * finds a free _block of heap memory for the calling process.
+ * if there is no free _block that satisfies the request then grows the 
+ * heap and returns a new _block.  Small requests are served from the
+ * thread cache without locking when it has an object of the right class,
+ * and from the slabs of an arena otherwise.
+ *
+ * \param size size of the requested memory in bytes
+ *
+ * \return returns the requested memory allocation to the calling process 
+ * or NULL if failed
+ */
+static void *mallocImpl(size_t size)
+{
+   mallocInit();
+
+   /* Handle 0 size */
+   if (size == 0 || size > PTRDIFF_MAX) 
+   {
+      return NULL;
+   }
+
+   /* Slab objects take multiples of ALIGNMENT, _blocks the size that keeps
+      the next _block aligned */
+   size = use_slabs && size <= SMALL_LIMIT ? ALIGN(size) : blockSize(size);
+
+   struct _arena *a;
+   struct _block *next;
+
+   struct _tcache *tc;
+   if (size <= SMALL_LIMIT && (tc = tcacheGet()) != NULL)
+   {
+      int c = sizeClass(size);
+
+      lat_path = PATH_CACHE;
+      if (tc->count[c] == 0)
+      {
+         tcacheRefill(tc, c);
+      }
+
+      void *p = tc->bins[c];
+      if (p)
+      {
+         tc->bins[c] = *tcacheNext(p);
+         tc->count[c]--;
+
+         TCACHE_COUNT(tc, num_mallocs, 1);
+         TCACHE_COUNT(tc, num_requested, size);
+         return p;
+      }
+   }
+   else if (size <= SMALL_LIMIT && use_slabs)
+   {
+      a = arenaLock();
+      void *p = slabAlloc(a, sizeClass(size));
+      if (p)
+      {
+         a->stats.num_mallocs++;
+         a->stats.num_requested += size;
+      }
+      pthread_mutex_unlock(&a->lock);
+
+      if (p)
+      {
+         return p;
+      }
+   }
+
+   /* The slab region ran out */
+   size = blockSize(size);
+
+   void *p;
+   if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+       (p = mmapMalloc(size)) != NULL)
+   {
+      return p;
+   }
+
+   a = arenaLock();
+   next = heapAlloc(a, size);
+
+   /* A secondary arena could not grow, so fall back to the main arena */
+   if (next == NULL && a != &main_arena)
+   {
+      pthread_mutex_unlock(&a->lock);
+      a = &main_arena;
+      pthread_mutex_lock(&a->lock);
+      remoteDrain(a);
+      next = heapAlloc(a, size);
+   }
+
+   if (next)
+   {
+      a->stats.num_mallocs++;
+      a->stats.num_requested += size;
+   }
+
+   pthread_mutex_unlock(&a->lock);
+
+   /* Return data address associated with _block to the user.  A _block
+      too large for a huge page heap gets a mapping of its own. */
+   return next ? BLOCK_DATA(next) : mmapMalloc(size);
+}
+
+/*
+ * \brief freeImpl
+ *
+ * frees the memory _block pointed to by pointer. if the _block is adjacent
+ * to another _block then coalesces (combines) them.  Small _blocks go to
+ * the thread cache first and reach their arena when the cache is flushed.
+ *
+ * \param ptr the heap memory to free
+ *
+ * \return none
+ */
+static void freeImpl(void *ptr)
+{
+   if (ptr == NULL) 
+   {
+      return;
+   }
+
+   struct _tcache *tc;
+   struct _arena *a;
+
+   if (isSlab(ptr))
+   {
+      int c = SLAB_OF(ptr)->class;
+
+      if ((tc = tcacheGet()) != NULL)
+      {
+         lat_path = PATH_CACHE;
+         if (tc->count[c] >= TCACHE_MAX)
+         {
+            tcacheFlush(tc, c, TCACHE_MAX / 2);
+            lat_path = PATH_SLAB;
+         }
+
+         *tcacheNext(ptr) = tc->bins[c];
+         tc->bins[c] = ptr;
+         tc->count[c]++;
+
+         TCACHE_COUNT(tc, num_frees, 1);
+         return;
+      }
+
+      lat_path = PATH_SLAB;
+      a = SLAB_OF(ptr)->arena;
+      pthread_mutex_lock(&a->lock);
+      slabFree(a, ptr);
+      a->stats.num_frees++;
+      pthread_mutex_unlock(&a->lock);
+      return;
+   }
+
+   struct _block *curr = BLOCK_HEADER(ptr);
+   assert(!BLOCK_IS_FREE(curr));
+
+   if (curr->size & BLOCK_MMAPPED)
+   {
+      size_t length = BLOCK_MAPPING(curr);
+      mmapFree(curr);
+      lat_path = PATH_MMAP;
+
+      a = arenaLock();
+      a->stats.num_frees++;
+      a->stats.mapped--;
+      a->stats.mapped_bytes -= length;
+      pthread_mutex_unlock(&a->lock);
+      return;
+   }
+
+   /* With slabs on, a small _block only exists if the slab region ran out,
+      and the cache only holds slab objects */
+   if (BLOCK_SIZE(curr) <= SMALL_LIMIT && !use_slabs && (tc = tcacheGet()) != NULL)
+   {
+      int c = sizeClass(BLOCK_SIZE(curr));
+
+      lat_path = PATH_CACHE;
+      if (tc->count[c] >= TCACHE_MAX)
+      {
+         tcacheFlush(tc, c, TCACHE_MAX / 2);
+         lat_path = PATH_COALESCE;
+      }
+
+      *tcacheNext(ptr) = tc->bins[c];
+      tc->bins[c] = ptr;
+      tc->count[c]++;
+
+      TCACHE_COUNT(tc, num_frees, 1);
+      return;
+   }
+
+   /* Make _block as free and merge it with free neighbours, or leave that
+      to the thread that locks its arena next */
+   a = arenaOf(curr);
+   if (a != thread_arena && (tc = tcacheGet()) != NULL)
+   {
+      remotePush(a, ptr, ptr);
+      lat_path = PATH_REMOTE;
+
+      TCACHE_COUNT(tc, num_frees, 1);
+      TCACHE_COUNT(tc, num_remote, 1);
+      return;
+   }
+
+   lat_path = PATH_COALESCE;
+   pthread_mutex_lock(&a->lock);
+   remoteDrain(a);
+   maybeTrim(a, coalesce(a, curr));
+   a->stats.num_frees++;
+   pthread_mutex_unlock(&a->lock);
+}
+
+/*
+ * \brief freeSizedImpl
+ *
+ * Frees memory whose size the caller knows.  A slab object then goes to
+ * the thread cache without reading its slab header for the class.
+ *
+ * \param ptr the memory to free
+ * \param size the size it was allocated with
+ *
+ * \return none
+ */
+static void freeSizedImpl(void *ptr, size_t size)
+{
+   struct _tcache *tc;
+
+   if (use_slabs && size - 1 < SMALL_LIMIT && isSlab(ptr) && (tc = tcacheGet()) != NULL)
+   {
+      /* Trusts the size: a wrong one files the object under the wrong
+         class, as it would with any sized delete */
+      int c = sizeClass(ALIGN(size));
+
+      lat_path = PATH_CACHE;
+      if (tc->count[c] >= TCACHE_MAX)
+      {
+         tcacheFlush(tc, c, TCACHE_MAX / 2);
+         lat_path = PATH_SLAB;
+      }
+
+      *tcacheNext(ptr) = tc->bins[c];
+      tc->bins[c] = ptr;
+      tc->count[c]++;
+
+      TCACHE_COUNT(tc, num_frees, 1);
+      return;
+   }
+
+   freeImpl(ptr);
+}
+
+/*
+ * \brief callocImpl
+ *
+ * Allocates zeroed memory, clearing only what may have been used before.
+ * Large requests take a mapping of their own even when the mmap threshold
+ * has risen, so their pages are only faulted in when first touched.
+ * Heap _blocks that were just grown are zero above the clean mark.
+ *
+ * \param nmemb number of elements
+ * \param size size of an element in bytes
+ *
+ * \return the memory, or NULL with errno set to ENOMEM if the product
+ * overflows or there is no memory
+ */
+static void *callocImpl(size_t nmemb, size_t size)
+{
+   size_t total_size;
+
+   if (__builtin_mul_overflow(nmemb, size, &total_size) || total_size > PTRDIFF_MAX)
+   {
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   mallocInit();
+
+   size_t threshold = __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED);
+   if (!__atomic_load_n(&mmap_threshold_fixed, __ATOMIC_RELAXED) &&
+       threshold > MMAP_THRESHOLD_DEFAULT)
+   {
+      threshold = MMAP_THRESHOLD_DEFAULT;
+   }
+
+   void *ptr;
+   if (total_size >= threshold && (ptr = mmapMalloc(blockSize(total_size))) != NULL)
+   {
+      return ptr;
+   }
+
+   fresh_from = NULL;
+   ptr = mallocImpl(total_size);
+   if (ptr == NULL)
+   {
+      return NULL;
+   }
+
+   /* Small requests come from caches that keep links in the objects */
+   size_t dirty = total_size;
+   if (total_size > SMALL_LIMIT && (BLOCK_HEADER(ptr)->size & BLOCK_MMAPPED))
+   {
+      dirty = 0;
+   }
+   else if (total_size > SMALL_LIMIT &&
+            fresh_from >= (char *)ptr && fresh_from < (char *)ptr + total_size)
+   {
+      dirty = fresh_from - (char *)ptr;
+   }
+   memset(ptr, 0, dirty);
+
+   return ptr;
+}
+
+static void *reallocImpl(void *ptr, size_t size)
+{
+   if (ptr == NULL) 
+   {
+      return mallocImpl(size);
+   }
+   if (size == 0) 
+   {
+      freeImpl(ptr);
+      return NULL;
+   }
+
+   if (size > PTRDIFF_MAX)
+   {
+      return NULL;
+   }
+
+   if (isSlab(ptr))
+   {
+      size_t slot = SLAB_OF(ptr)->size;
+      if (size <= slot)
+      {
+         lat_path = PATH_INPLACE;
+         return ptr;
+      }
+
+      void *new_ptr = mallocImpl(size);
+      if (new_ptr)
+      {
+         memcpy(new_ptr, ptr, slot);
+         freeImpl(ptr);
+         lat_path = PATH_MOVE;
+      }
+      return new_ptr;
+   }
+
+   struct _block *curr = BLOCK_HEADER(ptr);
+   size_t old_size = BLOCK_SIZE(curr);
+
+   /* Keep split _blocks on the same alignment as malloc */
+   size = blockSize(size);
+
+   struct _arena *a;
+
+   if (curr->size & BLOCK_MMAPPED)
+   {
+      lat_path = PATH_MMAP;
+
+      /* Once below the mmap threshold the data belongs in the heap */
+      if (size <= old_size && size < __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+      {
+         void *new_ptr = mallocImpl(size);
+         if (new_ptr)
+         {
+            memcpy(new_ptr, ptr, size);
+            freeImpl(ptr);
+            lat_path = PATH_MOVE;
+
+            a = arenaLock();
+            a->stats.num_moves++;
+            pthread_mutex_unlock(&a->lock);
+
+            return new_ptr;
+         }
+      }
+
+      /* Otherwise the mapping grows or shrinks with mremap(), unless the
+         shrink would not free a whole page */
+      if (size <= old_size && old_size - size < page_size)
+      {
+         return ptr;
+      }
+
+      size_t length = BLOCK_MAPPING(curr);
+      struct _block *b = mmapResize(curr, size);
+      if (b)
+      {
+         a = arenaLock();
+         a->stats.mapped_bytes += BLOCK_MAPPING(b) - length;
+         if (b == curr)
+         {
+            a->stats.num_inplace++;
+         }
+         else
+         {
+            a->stats.num_moves++;
+         }
+         pthread_mutex_unlock(&a->lock);
+
+         return BLOCK_DATA(b);
+      }
+      if (size <= old_size)
+      {
+         return ptr;
+      }
+   }
+   else
+   {
+      a = arenaOf(curr);
+      lat_path = PATH_INPLACE;
+
+      if (size <= old_size)
+      {
+         if (old_size - size >= BLOCK_OVERHEAD + BLOCK_MIN)
+         {
+            pthread_mutex_lock(&a->lock);
+            splitBlock(a, curr, size);
+            pthread_mutex_unlock(&a->lock);
+         }
+
+         return ptr;
+      }
+
+      pthread_mutex_lock(&a->lock);
+      bool grown = growInPlace(a, curr, size);
+      if (grown)
+      {
+         a->stats.num_inplace++;
+      }
+      pthread_mutex_unlock(&a->lock);
+
+      if (grown)
+      {
+         return ptr;
+      }
+   }
+
+   void *new_ptr = mallocImpl(size);
+   if (new_ptr)
+   {
+      memcpy(new_ptr, ptr, old_size);
+      freeImpl(ptr);
+      lat_path = PATH_MOVE;
+
+      a = arenaLock();
+      a->stats.num_moves++;
+      pthread_mutex_unlock(&a->lock);
+   }
+
+   return new_ptr;
+}
+
+/*
+ * The entry points.  They time the call when MALLOC_LATENCY is set, log
+ * it when MALLOC_TRACE is set and leave the work to the Impl functions,
+ * which is also what the allocator calls internally, so a realloc that
+ * moves counts once.
+ */
+
+void *malloc( size_t size )
+{
+   if (!hooked)
+   {
+      return mallocImpl(size);
+   }
+
+   uint64_t start = latencyTicks();
+   lat_path = PATH_OTHER;
+   void *ptr = mallocImpl(size);
+   if (latency_on)
+   {
+      latencyRecord(LAT_MALLOC, size, start);
+   }
+   if (trace_on)
+   {
+      traceRecord(MALLOC_TRACE_MALLOC, ptr, 0, size);
+   }
+
+   return ptr;
+}
+
+void free( void *ptr )
+{
+   if (!hooked)
+   {
+      freeImpl(ptr);
+      return;
+   }
+
+   if (trace_on && ptr)
+   {
+      traceRecord(MALLOC_TRACE_FREE, ptr, 0, 0);
+   }
+
+   /* Only the latency tables file a free by size */
+   size_t size = latency_on ? malloc_usable_size(ptr) : 0;
+   uint64_t start = latencyTicks();
+   lat_path = PATH_OTHER;
+   freeImpl(ptr);
+   if (latency_on)
+   {
+      latencyRecord(LAT_FREE, size, start);
+   }
+}
+
+/*
+ * \brief free_sized
+ *
+ * C23 free with the size the memory was allocated with, which spares
+ * small objects a lookup.
+ *
+ * \param ptr the memory to free, or NULL
+ * \param size the size passed to malloc or calloc
+ *
+ * \return none
+ */
+void free_sized( void *ptr, size_t size )
+{
+   if (!hooked)
+   {
+      freeSizedImpl(ptr, size);
+      return;
+   }
+
+   if (trace_on && ptr)
+   {
+      traceRecord(MALLOC_TRACE_FREE, ptr, 0, 0);
+   }
+
+   uint64_t start = latencyTicks();
+   lat_path = PATH_OTHER;
+   freeSizedImpl(ptr, size);
+   if (latency_on)
+   {
+      latencyRecord(LAT_FREE, size, start);
+   }
+}
+
+/*
+ * \brief free_aligned_sized
+ *
+ * \param ptr the memory to free, or NULL
+ * \param alignment the alignment passed to aligned_alloc
+ * \param size the size passed to aligned_alloc
+ *
+ * \return none
+ */
+void free_aligned_sized( void *ptr, size_t alignment, size_t size )
+{
+   if (alignment <= ALIGNMENT)
+   {
+      free_sized(ptr, size);
+   }
+   else
+   {
+      free(ptr);
+   }
+}
+
+void *calloc( size_t nmemb, size_t size )
+{
+   if (!hooked)
+   {
+      return callocImpl(nmemb, size);
+   }
+
+   uint64_t start = latencyTicks();
+   lat_path = PATH_OTHER;
+   void *ptr = callocImpl(nmemb, size);
+   if (latency_on)
+   {
+      latencyRecord(LAT_CALLOC, nmemb * size, start);
+   }
+   if (trace_on)
+   {
+      traceRecord(MALLOC_TRACE_CALLOC, ptr, 0, nmemb * size);
+   }
+
+   return ptr;
+}
+
+void *realloc( void *ptr, size_t size )
+{
+   if (!hooked)
+   {
+      return reallocImpl(ptr, size);
+   }
+
+   uint64_t start = latencyTicks();
+   lat_path = PATH_OTHER;
+   void *new_ptr = reallocImpl(ptr, size);
+   if (latency_on)
+   {
+      latencyRecord(LAT_REALLOC, size, start);
+   }
+   if (trace_on)
+   {
+      traceRecord(MALLOC_TRACE_REALLOC, new_ptr, (uintptr_t)ptr, size);
+   }
+
+   return new_ptr;
+}
+
+/* malloc_batch() carves its _blocks out of regions of up to this size */
+#define BATCH_REGION           (1024 * 1024)
+
+/*
+ * \brief carveBatch
+ *
+ * Takes one _block for up to n objects from the heap and cuts it into
+ * _blocks of size bytes, the last of which keeps whatever is left over.
+ *
+ * \param a the arena to allocate from, locked
+ * \param size size of each _block in bytes, from blockSize()
+ * \param ptrs where to store the data addresses
+ * \param n number of objects wanted
+ *
+ * \return number of objects stored, 0 if the heap could not grow
+ */
+static size_t carveBatch(struct _arena *a, size_t size, void **ptrs, size_t n)
+{
+   size_t k = BATCH_REGION / (size + BLOCK_OVERHEAD);
+   if (k > n)
+   {
+      k = n;
+   }
+   if (k == 0)
+   {
+      k = 1;
+   }
+
+   struct _block *b = heapAlloc(a, k * (size + BLOCK_OVERHEAD) - BLOCK_OVERHEAD);
+   if (b == NULL)
+   {
+      return 0;
+   }
+
+   char *end = (char *)BLOCK_NEXT(b);
+   for (size_t i = 0; i < k - 1; i++)
+   {
+      b->size = size | (b->size & BLOCK_FLAGS);
+      ptrs[i] = BLOCK_DATA(b);
+
+      b = BLOCK_NEXT(b);
+      b->size = (end - (char *)b - BLOCK_OVERHEAD) | BLOCK_PREV_INUSE;
+   }
+   ptrs[k - 1] = BLOCK_DATA(b);
+
+   a->stats.num_mallocs += k;
+   a->stats.num_requested += k * size;
+   a->stats.num_splits += k - 1;
+   a->stats.num_blocks += k - 1;
+
+   return k;
+}
+
+/*
+ * \brief mallocBatch
+ *
+ * Allocates n objects of one size under a single arena lock.  Small
+ * objects come from slabs, the rest are cut out of a few large _blocks,
+ * so the free lists are searched once per BATCH_REGION rather than once
+ * per object.  Objects too large for the heap are mapped one by one.
+ *
+ * \param size size of each object in bytes
+ * \param ptrs where to store the objects
+ * \param n number of objects
+ *
+ * \return number of objects allocated, fewer than n if memory ran out
+ */
+static size_t mallocBatch(size_t size, void **ptrs, size_t n)
+{
+   mallocInit();
+
+   if (size == 0 || size > PTRDIFF_MAX || n == 0)
+   {
+      return 0;
+   }
+
+   struct _arena *a;
+   size_t done = 0;
+
+   if (use_slabs && size <= SMALL_LIMIT)
+   {
+      int c = sizeClass(ALIGN(size));
+
+      a = arenaLock();
+      while (done < n && (ptrs[done] = slabAlloc(a, c)) != NULL)
+      {
+         done++;
+      }
+      a->stats.num_mallocs += done;
+      a->stats.num_requested += done * ALIGN(size);
+      pthread_mutex_unlock(&a->lock);
+   }
+
+   size = blockSize(size);
+
+   if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED))
+   {
+      while (done < n && (ptrs[done] = mmapMalloc(size)) != NULL)
+      {
+         done++;
+      }
+      return done;
+   }
+
+   if (done == n)
+   {
+      return done;
+   }
+
+   a = arenaLock();
+   while (done < n)
+   {
+      size_t k = carveBatch(a, size, ptrs + done, n - done);
+
+      /* A secondary arena could not grow, so fall back to the main arena */
+      if (k == 0 && a != &main_arena)
+      {
+         pthread_mutex_unlock(&a->lock);
+         a = &main_arena;
+         pthread_mutex_lock(&a->lock);
+         remoteDrain(a);
+         k = carveBatch(a, size, ptrs + done, n - done);
+      }
+      if (k == 0)
+      {
+         break;
+      }
+      done += k;
+   }
+   pthread_mutex_unlock(&a->lock);
+
+   return done;
+}
+
+/*
+ * \brief freeBatch
+ *
+ * Frees n objects, bypassing the thread cache.  The arena lock is taken
+ * once for each run of objects from the same arena rather than once per
+ * object, so a batch from malloc_batch() costs a single lock.
+ *
+ * \param ptrs the objects, NULL entries are skipped
+ * \param n number of entries
+ *
+ * \return none
+ */
+static void freeBatch(void **ptrs, size_t n)
+{
+   struct _arena *held = NULL;
+
+   for (size_t i = 0; i < n; i++)
+   {
+      void *ptr = ptrs[i];
+      if (ptr == NULL)
+      {
+         continue;
+      }
+
+      struct _arena *a;
+      struct _block *curr = NULL;
+      size_t length = 0;
+
+      if (isSlab(ptr))
+      {
+         a = SLAB_OF(ptr)->arena;
+      }
+      else
+      {
+         curr = BLOCK_HEADER(ptr);
+         assert(!BLOCK_IS_FREE(curr));
+
+         if (curr->size & BLOCK_MMAPPED)
+         {
+            length = BLOCK_MAPPING(curr);
+            mmapFree(curr);
+            curr = NULL;
+            a = held ? held : &main_arena;
+         }
+         else
+         {
+            a = arenaOf(curr);
+         }
+      }
+
+      if (a != held)
+      {
+         if (held)
+         {
+            pthread_mutex_unlock(&held->lock);
+         }
+         held = a;
+         pthread_mutex_lock(&a->lock);
+         remoteDrain(a);
+      }
+
+      if (length)
+      {
+         a->stats.mapped--;
+         a->stats.mapped_bytes -= length;
+      }
+      else if (curr)
+      {
+         maybeTrim(a, coalesce(a, curr));
+      }
+      else
+      {
+         slabFree(a, ptr);
+      }
+      a->stats.num_frees++;
+   }
+
+   if (held)
+   {
+      pthread_mutex_unlock(&held->lock);
+   }
+}
+
+size_t malloc_batch( size_t size, void **ptrs, size_t n )
+{
+   size_t done = mallocBatch(size, ptrs, n);
+
+   if (trace_on)
+   {
+      for (size_t i = 0; i < done; i++)
+      {
+         traceRecord(MALLOC_TRACE_MALLOC, ptrs[i], 0, size);
+      }
+   }
+
+   return done;
+}
+
+void free_batch( void **ptrs, size_t n )
+{
+   if (trace_on)
+   {
+      for (size_t i = 0; i < n; i++)
+      {
+         if (ptrs[i])
+         {
+            traceRecord(MALLOC_TRACE_FREE, ptrs[i], 0, 0);
+         }
+      }
+   }
+
+   freeBatch(ptrs, n);
+}
+
+/*
+ * \brief regionStart
+ *
+ * \param r a user arena
+ *
+ * \return the first byte its first heap hands out
+ */
+static inline char *regionStart(struct arena *r)
+{
+   return (char *)ALIGN((uintptr_t)(r + 1));
+}
+
+/*
+ * \brief regionMap
+ *
+ * Gives a large request of a user arena a mapping of its own, which is
+ * unmapped when the arena is reset.
+ *
+ * \param r the user arena
+ * \param alignment a power of two
+ * \param size size of the request in bytes
+ *
+ * \return the memory or NULL if mmap failed
+ */
+static void *regionMap(struct arena *r, size_t alignment, size_t size)
+{
+   if (alignment > PTRDIFF_MAX / 2 || size > PTRDIFF_MAX / 2)
+   {
+      return NULL;
+   }
+
+   size_t length = (sizeof(struct _mapping) + alignment + size + page_size - 1) &
+                   ~(page_size - 1);
+
+   struct _mapping *m = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (m == MAP_FAILED)
+   {
+      return NULL;
+   }
+
+   m->next = r->big;
+   m->length = length;
+   r->big = m;
+
+   return (void *)(((uintptr_t)(m + 1) + alignment - 1) & ~(alignment - 1));
+}
+
+/*
+ * \brief regionAlloc
+ *
+ * Bump allocates from a user arena.  When its newest heap is full the
+ * arena moves on to a new one; the rest of the old heap is not used
+ * until the arena is reset.
+ *
+ * \param r the user arena
+ * \param alignment a power of two of at least ALIGNMENT
+ * \param size size of the request in bytes
+ *
+ * \return the memory or NULL if no heap could be reserved
+ */
+static void *regionAlloc(struct arena *r, size_t alignment, size_t size)
+{
+   if (size > PTRDIFF_MAX)
+   {
+      return NULL;
+   }
+   size = size ? ALIGN(size) : ALIGNMENT;
+
+   if (size >= REGION_BIG || alignment >= REGION_BIG)
+   {
+      return regionMap(r, alignment, size);
+   }
+
+   struct _heap *h = r->heap;
+   char *p = (char *)(((uintptr_t)r->next + alignment - 1) & ~(alignment - 1));
+
+   if (p + size > (char *)h + h->committed)
+   {
+      char *end = p + size + REGION_COMMIT;
+      if (end > (char *)h + HEAP_MAX_SIZE)
+      {
+         end = (char *)h + HEAP_MAX_SIZE;
+      }
+
+      if (p + size > end || !heapCommit(h, end))
+      {
+         if ((h = heapCreate(NULL)) == NULL)
+         {
+            return NULL;
+         }
+         h->prev = r->heap;
+         r->heap = h;
+
+         p = (char *)(((uintptr_t)(h + 1) + alignment - 1) & ~(alignment - 1));
+         if (!heapCommit(h, p + size + REGION_COMMIT))
+         {
+            return NULL;
+         }
+      }
+   }
+
+   r->next = p + size;
+   return p;
+}
+
+/*
+ * \brief arena_create
+ *
+ * \return a new user arena, or NULL with errno set to ENOMEM
+ */
+struct arena *arena_create( void )
+{
+   mallocInit();
+
+   struct _heap *h = heapCreate(NULL);
+   if (h == NULL)
+   {
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   struct arena *r = (struct arena *)(h + 1);
+   r->heap = h;
+   r->big = NULL;
+   r->next = regionStart(r);
+
+   return r;
+}
+
+/*
+ * \brief arena_alloc
+ *
+ * \param r a user arena
+ * \param size size of the requested memory in bytes
+ *
+ * \return ALIGNMENT aligned memory that lives until the arena is reset,
+ * or NULL with errno set to ENOMEM
+ */
+void *arena_alloc( struct arena *r, size_t size )
+{
+   void *ptr = regionAlloc(r, ALIGNMENT, size);
+   if (ptr == NULL)
+   {
+      errno = ENOMEM;
+   }
+
+   return ptr;
+}
+
+/*
+ * \brief arena_aligned_alloc
+ *
+ * \param r a user arena
+ * \param alignment a power of two
+ * \param size size of the requested memory in bytes
+ *
+ * \return the memory, or NULL with errno set to EINVAL for a bad
+ * alignment or ENOMEM if failed
+ */
+void *arena_aligned_alloc( struct arena *r, size_t alignment, size_t size )
+{
+   if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+   {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   void *ptr = regionAlloc(r, alignment < ALIGNMENT ? ALIGNMENT : alignment, size);
+   if (ptr == NULL)
+   {
+      errno = ENOMEM;
+   }
+
+   return ptr;
+}
+
+/*
+ * \brief arena_reset
+ *
+ * Frees everything allocated from a user arena at once.  The first heap
+ * stays committed for the next round; later heaps and large requests are
+ * given back to the OS.
+ *
+ * \param r a user arena
+ *
+ * \return none
+ */
+void arena_reset( struct arena *r )
+{
+   while (r->big)
+   {
+      struct _mapping *m = r->big;
+      r->big = m->next;
+      munmap(m, m->length);
+   }
+
+   while (r->heap->prev)
+   {
+      struct _heap *h = r->heap;
+      r->heap = h->prev;
+      munmap(h, HEAP_MAX_SIZE);
+   }
+
+   r->next = regionStart(r);
+}
+
+/*
+ * \brief arena_destroy
+ *
+ * \param r a user arena, or NULL
+ *
+ * \return none
+ */
+void arena_destroy( struct arena *r )
+{
+   if (r == NULL)
+   {
+      return;
+   }
+
+   arena_reset(r);
+   munmap(r->heap, HEAP_MAX_SIZE);
+}
+
+/*
+ * \brief alignData
+ *
+ * Carves a _block whose data is aligned out of an in use _block that is
+ * at least alignment + BLOCK_OVERHEAD + BLOCK_MIN bytes larger than
+ * needed.  The slack in front becomes a free _block of its own and the
+ * slack behind is split off.
+ *
+ * \param a the arena owning the _block, locked
+ * \param b the _block
+ * \param alignment a power of two above ALIGNMENT
+ * \param size size of the aligned _block in bytes
+ *
+ * \return the aligned _block
+ */
+static struct _block *alignData(struct _arena *a, struct _block *b,
+                                size_t alignment, size_t size)
+{
+   uintptr_t data = (uintptr_t)BLOCK_DATA(b);
+
+   if (data & (alignment - 1))
+   {
+      /* Leave room for a free _block in front */
+      uintptr_t aligned = (data + BLOCK_OVERHEAD + BLOCK_MIN + alignment - 1) & ~(alignment - 1);
+      struct _block *n = BLOCK_HEADER(aligned);
+      size_t lead = (char *)n - (char *)b - BLOCK_OVERHEAD;
+
+      n->size = BLOCK_SIZE(b) - lead - BLOCK_OVERHEAD;
+      b->size = lead | (b->size & BLOCK_FLAGS);
+
+      a->stats.num_splits++;
+      a->stats.num_blocks++;
+
+      coalesce(a, b);
+      b = n;
+   }
+
+   if (BLOCK_SIZE(b) - size >= BLOCK_OVERHEAD + BLOCK_MIN)
+   {
+      splitBlock(a, b, size);
+   }
+
+   return b;
+}
+
+/*
+ * \brief alignedAllocImpl
+ *
+ * Allocates size bytes aligned to alignment.  Alignments up to ALIGNMENT
+ * are what malloc gives anyway.  Larger ones take a mapping of their own
+ * past the mmap threshold and a _block trimmed to the alignment
+ * otherwise.
+ *
+ * \param alignment a power of two
+ * \param size size of the requested memory in bytes
+ *
+ * \return the memory or NULL if failed
+ */
+static void *alignedAllocImpl(size_t alignment, size_t size)
+{
+   if (alignment <= ALIGNMENT)
+   {
+      return mallocImpl(size);
+   }
+
+   mallocInit();
+
+   if (size == 0 || size > PTRDIFF_MAX || alignment > PTRDIFF_MAX - size)
+   {
+      return NULL;
+   }
+
+   size = blockSize(size);
+
+   struct _arena *a;
+   struct _block *next;
+
+   if (size >= __atomic_load_n(&mmap_threshold, __ATOMIC_RELAXED) &&
+       (next = mmapAligned(alignment, size)) != NULL)
+   {
+      lat_path = PATH_MMAP;
+      a = arenaLock();
+      a->stats.num_mmaps++;
+      a->stats.num_mallocs++;
+      a->stats.num_requested += size;
+      a->stats.mapped++;
+      a->stats.mapped_bytes += BLOCK_MAPPING(next);
+      pthread_mutex_unlock(&a->lock);
+
+      return BLOCK_DATA(next);
+   }
+
+   size_t padded = size + alignment + BLOCK_OVERHEAD + BLOCK_MIN;
+
+   a = arenaLock();
+   next = heapAlloc(a, padded);
+
+   /* A secondary arena could not grow, so fall back to the main arena */
+   if (next == NULL && a != &main_arena)
+   {
+      pthread_mutex_unlock(&a->lock);
+      a = &main_arena;
+      pthread_mutex_lock(&a->lock);
+      remoteDrain(a);
+      next = heapAlloc(a, padded);
+   }
+
+   if (next)
+   {
+      next = alignData(a, next, alignment, size);
+
+      a->stats.num_mallocs++;
+      a->stats.num_requested += size;
+   }
+
+   pthread_mutex_unlock(&a->lock);
+
+   return next ? BLOCK_DATA(next) : NULL;
+}
+
+/*
+ * \brief alignedAlloc
+ *
+ * What the aligned entry points call, which logs the allocation when
+ * MALLOC_TRACE is set.
+ *
+ * \param alignment a power of two
+ * \param size size of the requested memory in bytes
+ *
+ * \return the memory or NULL if failed
+ */
+static void *alignedAlloc(size_t alignment, size_t size)
+{
+   void *ptr = alignedAllocImpl(alignment, size);
+   if (trace_on)
+   {
+      traceRecord(MALLOC_TRACE_MEMALIGN, ptr, alignment, size);
+   }
+
+   return ptr;
+}
+
+/*
+ * \brief posix_memalign
+ *
+ * \param memptr where to store the memory
+ * \param alignment a power of two multiple of sizeof(void *)
+ * \param size size of the requested memory in bytes
+ *
+ * \return 0 on success, EINVAL for a bad alignment, ENOMEM if failed
+ */
+int posix_memalign( void **memptr, size_t alignment, size_t size )
+{
+   if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 ||
+       alignment == 0)
+   {
+      return EINVAL;
+   }
+
+   void *ptr = alignedAlloc(alignment, size);
+   if (ptr == NULL && size != 0)
+   {
+      return ENOMEM;
+   }
+
+   *memptr = ptr;
+   return 0;
+}
+
+/*
+ * \brief aligned_alloc
+ *
+ * \param alignment a power of two
+ * \param size size of the requested memory in bytes
+ *
+ * \return the memory, or NULL with errno set to EINVAL for a bad
+ * alignment or ENOMEM if failed
+ */
+void *aligned_alloc( size_t alignment, size_t size )
+{
+   if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+   {
+      errno = EINVAL;
+      return NULL;
+   }
 
-#define ALIGN4(s)         (((((s) - 1) >> 2) << 2) + 4)
-#define BLOCK_DATA(b)     ((b) + 1)
-#define BLOCK_HEADER(ptr) ((struct _block *)(ptr) - 1)
+   void *ptr = alignedAlloc(alignment, size);
+   if (ptr == NULL && size != 0)
+   {
+      errno = ENOMEM;
+   }
 
-static int atexit_registered = 0;
-static int num_mallocs       = 0;
-static int num_frees         = 0;
-static int num_reuses        = 0;
-static int num_grows         = 0;
-static int num_splits        = 0;
-static int num_coalesces     = 0;
-static int num_blocks        = 0;
-static int num_requested     = 0;
-static int max_heap          = 0;
+   return ptr;
+}
 
 /*
- *  \brief printStatistics
+ * \brief memalign
  *
- *  \param none
+ * Obsolete form of aligned_alloc.  Like glibc, an alignment that is not
+ * a power of two is rounded up to one.
  *
- *  Prints the heap statistics upon process exit.  Registered
- *  via atexit()
+ * \param alignment the alignment in bytes
+ * \param size size of the requested memory in bytes
  *
- *  \return none
+ * \return the memory or NULL if failed
  */
-void printStatistics( void )
+void *memalign( size_t alignment, size_t size )
 {
-  printf("\nheap management statistics\n");
-  printf("mallocs:\t%d\n", num_mallocs );
-  printf("frees:\t\t%d\n", num_frees );
-  printf("reuses:\t\t%d\n", num_reuses );
-  printf("grows:\t\t%d\n", num_grows );
-  printf("splits:\t\t%d\n", num_splits );
-  printf("coalesces:\t%d\n", num_coalesces );
-  printf("blocks:\t\t%d\n", num_blocks );
-  printf("requested:\t%d\n", num_requested );
-  printf("max heap:\t%d\n", max_heap );
+   if (alignment & (alignment - 1))
+   {
+      if (alignment > PTRDIFF_MAX / 2 + 1)
+      {
+         errno = EINVAL;
+         return NULL;
+      }
+      alignment = (size_t)1 << (64 - __builtin_clzl(alignment));
+   }
+
+   return alignedAlloc(alignment, size);
 }
 
-struct _block 
+/*
+ * \brief valloc
+ *
+ * \param size size of the requested memory in bytes
+ *
+ * \return page aligned memory or NULL if failed
+ */
+void *valloc( size_t size )
 {
-   size_t  size;         /* Size of the allocated _block of memory in bytes     */
-   struct _block *next;  /* Pointer to the next _block of allocated memory      */
-   struct _block *prev;  /* Pointer to the previous _block of allocated memory  */
-   bool   free;          /* Is this _block free?                                */
-   char   padding[3];    /* Padding: IENTRTMzMjAgU3jMDEED                       */
-};
-
+   mallocInit();
 
-struct _block *heapList = NULL; /* Free list to track the _blocks available */
-struct _block *last_allocated = NULL; // for Next Fit
+   return alignedAlloc(page_size, size);
+}
 
 /*
- * \brief findFreeBlock
- *
- * \param last pointer to the linked list of free _blocks
- * \param size size of the _block needed in bytes 
+ * \brief pvalloc
  *
- * \return a _block that fits the request or NULL if no free _block matches
+ * \param size size of the requested memory in bytes, rounded up to whole
+ * pages
  *
- * \TODO Implement Next Fit
- * \TODO Implement Best Fit
- * \TODO Implement Worst Fit
+ * \return page aligned memory or NULL if failed
  */
-struct _block *findFreeBlock(struct _block **last, size_t size) 
+void *pvalloc( size_t size )
 {
-   struct _block *curr = heapList;
+   mallocInit();
 
-#if defined FIT && FIT == 0
-   /* First fit */
-   //
-   // While we haven't run off the end of the linked list and
-   // while the current node we point to isn't free or isn't big enough
-   // then continue to iterate over the list.  This loop ends either
-   // with curr pointing to NULL, meaning we've run to the end of the list
-   // without finding a node or it ends pointing to a free node that has enough
-   // space for the request.
-   // 
-   while (curr && !(curr->free && curr->size >= size)) 
+   size_t rounded = (size + page_size - 1) & ~(page_size - 1);
+   if (rounded < size)
    {
-      *last = curr;
-      curr  = curr->next;
+      return NULL;
    }
-#endif
 
-// BEST FIT - WORKS
-// \TODO Put your Best Fit code in this #ifdef block
-#if defined BEST && BEST == 0
-   /** \TODO Implement best fit here */
-   struct _block *best_fit = NULL;
-   size_t best_size = SIZE_MAX;
-   while (curr)
+   return alignedAlloc(page_size, rounded ? rounded : page_size);
+}
+
+/*
+ * \brief malloc_usable_size
+ *
+ * \param ptr memory handed out by this allocator, or NULL
+ *
+ * \return number of bytes the caller may use at ptr, which can be more
+ * than it asked for
+ */
+size_t malloc_usable_size( void *ptr )
+{
+   if (ptr == NULL)
    {
-      if (curr->free && curr->size >= size && curr->size < best_size)
-      {
-         best_fit = curr;
-         best_size = curr->size;
-      }
-   
-      *last = curr;
-      curr = curr->next;
+      return 0;
    }
 
-   curr = best_fit;
-
-#endif
-
-// WORST FIT - WORKS
-// \TODO Put your Worst Fit code in this #ifdef block
-#if defined WORST && WORST == 0
-   /** \TODO Implement worst fit here */
-   struct _block *worst_fit = NULL;
-   size_t worst_size = 0;
-   
-   while (curr)
+   if (isSlab(ptr))
    {
-      if (curr->free && curr->size >= size && curr->size > worst_size)
-      {
-         worst_fit = curr;
-         worst_size = curr->size;
-      }
-      
-      *last = curr;
-      curr = curr->next;
+      return SLAB_OF(ptr)->size;
    }
 
-   curr = worst_fit;
+   return BLOCK_SIZE(BLOCK_HEADER(ptr));
+}
 
-#endif
+/*
+ * C++ operator new and delete, under their LP64 Itanium ABI names.
+ * libstdc++ would only forward them to malloc and free; here sized
+ * delete becomes free_sized().  std::align_val_t is a size_t and std::nothrow_t is only
+ * passed by reference, so the C signatures match.  A failed new calls
+ * the new_handler until there is none and then throws std::bad_alloc
+ * through libstdc++, which is loaded in any program that calls these.
+ * The nothrow forms return NULL instead, but C cannot catch a handler
+ * that throws, so such a handler escapes them.
+ */
+typedef void (*new_handler_t)(void);
 
-// NEXT FIT - WORKS
-// \TODO Put your Next Fit code in this #ifdef block
-#if defined NEXT && NEXT == 0
-   /** \TODO Implement next fit here */
-   if (last_allocated)
+extern new_handler_t _ZSt15get_new_handlerv(void) __attribute__((weak));
+extern void _ZSt17__throw_bad_allocv(void) __attribute__((weak, noreturn));
+
+/*
+ * \brief cxxNew
+ *
+ * \param size size of the object in bytes, 0 included
+ * \param alignment alignment of the object
+ * \param nothrow whether to return NULL rather than throw
+ *
+ * \return the memory, or NULL for nothrow if there is none
+ */
+static void *cxxNew(size_t size, size_t alignment, bool nothrow)
+{
+   if (size == 0)
    {
-      curr = last_allocated->next;
+      size = 1;
    }
 
-   while (curr && !(curr->free && curr->size >= size)) 
+   for (;;)
    {
-      *last = curr;
-      curr = curr->next;
-      last_allocated = curr;
+      void *ptr = alignment > ALIGNMENT ? alignedAlloc(alignment, size) : malloc(size);
+      if (ptr)
+      {
+         return ptr;
+      }
+
+      new_handler_t handler = _ZSt15get_new_handlerv ? _ZSt15get_new_handlerv() : NULL;
+      if (handler == NULL)
+      {
+         break;
+      }
+      handler();
    }
-   
-   if (curr)
+
+   if (!nothrow)
    {
-      last_allocated = curr;
+      if (_ZSt17__throw_bad_allocv)
+      {
+         _ZSt17__throw_bad_allocv();
+      }
+      abort();
    }
 
-#endif
+   return NULL;
+}
 
-   return curr;
+/* operator new(size_t) and new[], plain, nothrow and aligned */
+void *_Znwm( size_t size )                     { return cxxNew(size, 0, false); }
+void *_Znam( size_t size )                     { return cxxNew(size, 0, false); }
+void *_ZnwmRKSt9nothrow_t( size_t size, const void *nt ) { return cxxNew(size, 0, true); }
+void *_ZnamRKSt9nothrow_t( size_t size, const void *nt ) { return cxxNew(size, 0, true); }
+void *_ZnwmSt11align_val_t( size_t size, size_t al )     { return cxxNew(size, al, false); }
+void *_ZnamSt11align_val_t( size_t size, size_t al )     { return cxxNew(size, al, false); }
+void *_ZnwmSt11align_val_tRKSt9nothrow_t( size_t size, size_t al, const void *nt )
+{
+   return cxxNew(size, al, true);
+}
+void *_ZnamSt11align_val_tRKSt9nothrow_t( size_t size, size_t al, const void *nt )
+{
+   return cxxNew(size, al, true);
+}
+
+/* operator delete(void *) and delete[], plain, sized, nothrow and aligned */
+void _ZdlPv( void *ptr )                       { free(ptr); }
+void _ZdaPv( void *ptr )                       { free(ptr); }
+void _ZdlPvm( void *ptr, size_t size )         { free_sized(ptr, size); }
+void _ZdaPvm( void *ptr, size_t size )         { free_sized(ptr, size); }
+void _ZdlPvRKSt9nothrow_t( void *ptr, const void *nt )   { free(ptr); }
+void _ZdaPvRKSt9nothrow_t( void *ptr, const void *nt )   { free(ptr); }
+void _ZdlPvSt11align_val_t( void *ptr, size_t al )       { free(ptr); }
+void _ZdaPvSt11align_val_t( void *ptr, size_t al )       { free(ptr); }
+void _ZdlPvmSt11align_val_t( void *ptr, size_t size, size_t al )
+{
+   free_aligned_sized(ptr, al, size);
+}
+void _ZdaPvmSt11align_val_t( void *ptr, size_t size, size_t al )
+{
+   free_aligned_sized(ptr, al, size);
 }
+void _ZdlPvSt11align_val_tRKSt9nothrow_t( void *ptr, size_t al, const void *nt ) { free(ptr); }
+void _ZdaPvSt11align_val_tRKSt9nothrow_t( void *ptr, size_t al, const void *nt ) { free(ptr); }
 
 /*
- * \brief growheap
+ * \brief malloc_heap_alloc
  *
- * Given a requested size of memory, use sbrk() to dynamically 
- * increase the data segment of the calling process.  Updates
- * the free list with the newly allocated memory.
+ * Allocates from one arena whichever CPU the caller runs on, for data
+ * that should stay together, such as a pmr container's.  The memory
+ * skips the thread cache and the slabs, and goes back with free() like
+ * any other _block.
  *
- * \param last tail of the free _block list
- * \param size size in bytes to request from the OS
+ * \param heap the arena, taken modulo the number of arenas
+ * \param alignment a power of two, or 0 for the malloc alignment
+ * \param size size of the requested memory in bytes
  *
- * \return returns the newly allocated _block of NULL if failed
+ * \return the memory or NULL if failed
  */
-struct _block *growHeap(struct _block *last, size_t size) 
+void *malloc_heap_alloc( unsigned int heap, size_t alignment, size_t size )
 {
-   /* Request more space from OS */
-   struct _block *curr = (struct _block *)sbrk(0);
-   struct _block *prev = (struct _block *)sbrk(sizeof(struct _block) + size);
-
-   assert(curr == prev);
+   mallocInit();
 
-   /* OS allocation failed */
-   if (curr == (struct _block *)-1) 
+   if (size == 0 || size > PTRDIFF_MAX || alignment > PTRDIFF_MAX - size)
    {
       return NULL;
    }
 
-   /* Update heapList if not set */
-   if (heapList == NULL) 
+   size = blockSize(size);
+
+   size_t padded = alignment > ALIGNMENT ? size + alignment + BLOCK_OVERHEAD + BLOCK_MIN : size;
+   struct _arena *a = arenaGet(heap % num_arenas);
+
+   pthread_mutex_lock(&a->lock);
+   remoteDrain(a);
+   struct _block *next = heapAlloc(a, padded);
+   if (next)
    {
-      heapList = curr;
+      if (alignment > ALIGNMENT)
+      {
+         next = alignData(a, next, alignment, size);
+      }
+
+      a->stats.num_mallocs++;
+      a->stats.num_requested += size;
    }
+   pthread_mutex_unlock(&a->lock);
 
-   /* Attach new _block to previous _block */
-   if (last) 
+   void *ptr = next ? BLOCK_DATA(next) : NULL;
+   if (trace_on)
    {
-      last->next = curr;
+      traceRecord(MALLOC_TRACE_MEMALIGN, ptr, alignment, size);
    }
 
-   /* Update _block metadata:
-      Set the size of the new block and initialize the new block to "free".
-      Set its next pointer to NULL since it's now the tail of the linked list.
-   */
-   curr->size = size;
-   curr->next = NULL;
-   curr->free = false;
-   
-   num_blocks++;
-   max_heap = max_heap + size;
-
-   return curr;
+   return ptr;
 }
 
 /*
- * \brief malloc
+ * \brief mallopt
  *
- * finds a free _block of heap memory for the calling process.
- * if there is no free _block that satisfies the request then grows the 
- * heap and returns a new _block
+ * Adjusts allocator parameters at run time.  M_MMAP_THRESHOLD and
+ * M_TRIM_THRESHOLD are supported; setting either one stops the dynamic
+ * threshold from changing it.
  *
- * \param size size of the requested memory in bytes
+ * \param param the parameter to set
+ * \param value the new value
  *
- * \return returns the requested memory allocation to the calling process 
- * or NULL if failed
+ * \return 1 on success, 0 if the parameter or value is not supported
  */
-void *malloc(size_t size) 
+int mallopt( int param, int value )
 {
+   mallocInit();
 
-   if( atexit_registered == 0 )
+   switch (param)
    {
-      atexit_registered = 1;
-      atexit( printStatistics );
+      case M_MMAP_THRESHOLD:
+         if (value < 0 || value > MMAP_THRESHOLD_MAX)
+         {
+            return 0;
+         }
+         __atomic_store_n(&mmap_threshold, (size_t)value, __ATOMIC_RELAXED);
+         __atomic_store_n(&mmap_threshold_fixed, true, __ATOMIC_RELAXED);
+         return 1;
+
+      case M_TRIM_THRESHOLD:
+         if (value < 0)
+         {
+            return 0;
+         }
+         __atomic_store_n(&trim_threshold, (size_t)value, __ATOMIC_RELAXED);
+         __atomic_store_n(&trim_threshold_fixed, true, __ATOMIC_RELAXED);
+         return 1;
+
+      default:
+         return 0;
    }
+}
 
-   /* Align to multiple of 4 */
-   size = ALIGN4(size);
+/*
+ * \brief purgeBlock
+ *
+ * Drops the whole pages inside a free _block, past its size tree links
+ * and short of the boundary tag in its last word.
+ *
+ * \param a the arena owning the _block, locked
+ * \param b the free _block
+ *
+ * \return 1 if any pages were dropped, 0 otherwise
+ */
+static int purgeBlock(struct _arena *a, struct _block *b)
+{
+   /* sbrk memory of the main arena lies outside any heap */
+   char *p = (char *)b;
+   bool in_sbrk = a == &main_arena && p >= main_lo && p < main_hi;
+   size_t unit = a->heap && !in_sbrk ? heapUnit(HEAP_OF(b)) : page_size;
+   uintptr_t start = ((uintptr_t)(BLOCK_NODE(b) + 1) + unit - 1) & ~(unit - 1);
+   uintptr_t end = ((uintptr_t)BLOCK_NEXT(b)) & ~(unit - 1);
 
-   /* Handle 0 size */
-   if (size == 0) 
+   if (end > start && madvise((void *)start, end - start, MADV_DONTNEED) == 0)
    {
-      return NULL;
+      a->stats.num_purged += end - start;
+      return 1;
    }
 
-   /* Look for free _block.  If a free block isn't found then we need to grow our heap. */
+   return 0;
+}
 
-   struct _block *last = heapList;
-   struct _block *next = findFreeBlock(&last, size);
+/*
+ * \brief slabPurge
+ *
+ * Drops the pages of the empty slabs in slab_free.  They move from the
+ * list to slab_dropped, and slabCreate() takes them from there once the
+ * list is empty.
+ *
+ * \return 1 if any pages were dropped, 0 otherwise
+ */
+static int slabPurge(void)
+{
+   struct _slab *kept = NULL;
+   int released = 0;
 
-   /* TODO: If the block found by findFreeBlock is larger than we need then:
-            If the leftover space in the new block is greater than the sizeof(_block)+4 then
-            split the block.
-            If the leftover space in the new block is less than the sizeof(_block)+4 then
-            don't split the block.
-   */
+   pthread_mutex_lock(&slab_lock);
 
-   /* Could not find free _block, so grow heap */
-   if (next == NULL) 
+   while (slab_free)
    {
-      next = growHeap(last, size);
-      num_grows++;
-   }
+      struct _slab *s = slab_free;
+      slab_free = s->next;
 
-   /* Could not find free _block or grow heap, so just return NULL */
-   if (next == NULL) 
-   {
-      return NULL;
-   }
+      if (madvise(s, SLAB_SIZE, MADV_DONTNEED) != 0)
+      {
+         s->next = kept;
+         kept = s;
+         continue;
+      }
 
-   // added
-   if (next->size > size + sizeof(struct _block))
-   {
-      num_splits++;
-      num_blocks++;
-      struct _block *split = (struct _block *)((char *)next + size + sizeof(struct _block));
-      split->size = next->size - size - sizeof(struct _block);
-      split->next = next->next;
-      split->prev = next;
-      split->free = true;
-      next->size = size;
-      next->next = split;
-      //num_splits++;
-   }
-   
-   // added reuses
-   else if(next != NULL && next->size >= size)
-   {
-      num_reuses++;
+      size_t index = ((char *)s - slab_lo) / SLAB_SIZE;
+      slab_dropped[index / 64] |= 1ULL << (index % 64);
+      if (index / 64 < slab_drop_hint)
+      {
+         slab_drop_hint = index / 64;
+      }
+      slab_num_dropped++;
+      slab_purged += SLAB_SIZE;
+      released = 1;
    }
+   slab_free = kept;
 
-   /* Mark _block as in use */
-   next->free = false;
-
-   num_mallocs++;
-   num_requested += size;
-   //num_blocks++;
+   pthread_mutex_unlock(&slab_lock);
 
-   /* Return data address associated with _block to the user */
-   return BLOCK_DATA(next);
+   return released;
 }
 
 /*
- * \brief free
- *
- * frees the memory _block pointed to by pointer. if the _block is adjacent
- * to another _block then coalesces (combines) them
+ * \brief treePurge
  *
- * \param ptr the heap memory to free
+ * \param a the arena, locked
+ * \param root root of the subtree to purge
  *
- * \return none
+ * \return 1 if any pages were dropped, 0 otherwise
  */
-void free(void *ptr) 
+static int treePurge(struct _arena *a, struct _block *root)
 {
-   if (ptr == NULL) 
+   if (root == NULL)
    {
-      return;
+      return 0;
    }
 
-   /* Make _block as free */
-   struct _block *curr = BLOCK_HEADER(ptr);
-   //assert(curr->free == 0);
-   curr->free = true;
+   return purgeBlock(a, root) | treePurge(a, BLOCK_NODE(root)->left) |
+          treePurge(a, BLOCK_NODE(root)->right);
+}
+
+/*
+ * \brief malloc_trim
+ *
+ * Gives unused heap memory back to the OS.  The free _block at the end of
+ * every arena is trimmed down to pad bytes, and the whole pages inside
+ * every other free _block are dropped with madvise(MADV_DONTNEED).  The
+ * _blocks stay on their free lists and read back as zeroes.  Empty slabs
+ * are dropped the same way.
+ *
+ * \param pad bytes to keep free at the end of each arena
+ *
+ * \return 1 if any memory was released, 0 otherwise
+ */
+int malloc_trim( size_t pad )
+{
+   mallocInit();
 
-   // Coalese blocks. if next block || prev block are free,
-   // combine them with the block being freed
+   int released = 0;
 
-   struct _block *current = heapList;
-   while(current != NULL)
+   for (int i = 0; i < num_arenas; i++)
    {
-      if(current->free && current->next != NULL && current->next->free)
+      struct _arena *a = __atomic_load_n(&arenas[i], __ATOMIC_ACQUIRE);
+      if (a == NULL)
       {
-         current->size += sizeof(struct _block) + current->next->size;
-         current->next = current->next->next;
+         continue;
+      }
 
-         num_coalesces++;
-         num_blocks--;
+      pthread_mutex_lock(&a->lock);
+      remoteDrain(a);
+
+      if (heapTrim(a, pad) > 0)
+      {
+         released = 1;
       }
 
+      /* Only _blocks above SMALL_LIMIT can span a page.  When the policy
+         keeps a size tree, all of them are in it. */
+      if (a->tree)
+      {
+         released |= treePurge(a, a->tree);
+      }
       else
       {
-         current = current->next;
+         for (int c = NUM_SMALL_CLASSES; c < NUM_CLASSES; c++)
+         {
+            for (struct _block *b = a->freeHead[c]; b; b = b->next_free)
+            {
+               released |= purgeBlock(a, b);
+            }
+         }
       }
+
+      pthread_mutex_unlock(&a->lock);
    }
 
-   // AI did not help in this section, had to redo this whole part
-   /*
-   if (curr->next && curr->next->free)
+   released |= slabPurge();
+
+   return released;
+}
+
+
+/*
+ * \brief largestFree
+ *
+ * \param a the arena, locked
+ *
+ * \return size of the largest free _block in the arena
+ */
+static size_t largestFree(struct _arena *a)
+{
+   if (a->tree)
    {
-      curr->size += sizeof(struct _block) + curr->next->size;
-      curr->next = curr->next->next;
+      return BLOCK_SIZE(treeLast(a->tree));
+   }
 
+   if (a->freeMap == 0)
+   {
+      return 0;
+   }
 
-      if (curr->next)
+   /* The classes do not overlap, so it is in the highest one */
+   size_t largest = 0;
+   for (struct _block *b = a->freeHead[63 - __builtin_clzll(a->freeMap)]; b;
+        b = b->next_free)
+   {
+      if (BLOCK_SIZE(b) > largest)
       {
-         curr->next->prev = curr;
+         largest = BLOCK_SIZE(b);
       }
-      
-      num_coalesces++; // inc coalescing amount
    }
 
-   // coalesce with prev block if it is free
-   if (curr->prev && curr->prev->free)
+   return largest;
+}
+
+/*
+ * \brief statsCollect
+ *
+ * Adds up the counters of every arena, every thread cache and the threads
+ * that have exited, and measures the free space of the heaps.  Takes each
+ * lock in turn, so the result is not one snapshot, but never calls
+ * malloc.
+ *
+ * \param info where to store the statistics
+ *
+ * \return none
+ */
+static void statsCollect(struct malloc_stats_info *info)
+{
+   struct _counters total = { 0 };
+   size_t free_bytes = 0;
+   size_t free_blocks = 0;
+   size_t largest = 0;
+   size_t huge_bytes = 0;
+
+   for (int i = 0; i < num_arenas; i++)
    {
-      curr->prev->size += sizeof(struct _block) + curr->size;
-      curr->prev->next = curr->next;
+      struct _arena *a = __atomic_load_n(&arenas[i], __ATOMIC_ACQUIRE);
+      if (a == NULL)
+      {
+         continue;
+      }
 
-      if (curr->next)
+      pthread_mutex_lock(&a->lock);
+      countersAdd(&total, &a->stats);
+      free_bytes += a->free_bytes;
+      free_blocks += a->free_blocks;
+      size_t l = largestFree(a);
+      if (l > largest)
       {
-         curr->next->prev = curr->prev;
+         largest = l;
       }
-      
-      num_coalesces++; // inc coalescing amount
-      num_blocks--; // decrement block after coalescing
+      for (struct _heap *h = a->heap; h; h = h->prev)
+      {
+         huge_bytes += h->huge != HUGE_OFF ? h->committed : 0;
+      }
+      pthread_mutex_unlock(&a->lock);
    }
-   */
 
-   num_frees++;
+   pthread_mutex_lock(&tcache_lock);
+   for (struct _tcache *tc = tcache_list; tc; tc = tc->next)
+   {
+      countersAdd(&total, &tc->stats);
+   }
+   countersAdd(&total, &tcache_exited);
+   pthread_mutex_unlock(&tcache_lock);
+
+   pthread_mutex_lock(&slab_lock);
+   info->slab_bytes = slab_lo ? slab_committed - slab_lo - slab_num_dropped * SLAB_SIZE : 0;
+   total.num_purged += slab_purged;
+   pthread_mutex_unlock(&slab_lock);
+
+   info->mallocs       = total.num_mallocs;
+   info->frees         = total.num_frees;
+   info->reuses        = total.num_reuses;
+   info->grows         = total.num_grows;
+   info->carves        = total.num_carves;
+   info->mmaps         = total.num_mmaps;
+   info->inplace       = total.num_inplace;
+   info->moves         = total.num_moves;
+   info->switches      = total.num_switches;
+   info->slabs         = total.num_slabs;
+   info->remote        = total.num_remote;
+   info->splits        = total.num_splits;
+   info->coalesces     = total.num_coalesces;
+   info->requested     = total.num_requested;
+   info->max_heap      = total.max_heap;
+   info->trimmed       = total.num_trimmed;
+   info->purged        = total.num_purged;
+   info->blocks        = total.num_blocks;
+   info->heap_bytes    = total.max_heap - total.num_trimmed;
+   info->mmap_blocks   = total.mapped;
+   info->mmap_bytes    = total.mapped_bytes;
+   info->huge_bytes    = huge_bytes;
+   info->free_blocks   = free_blocks;
+   info->free_bytes    = free_bytes;
+   info->largest_free  = largest;
+   info->fragmentation = free_bytes ? 1.0 - (double)largest / free_bytes : 0.0;
 }
 
-void *calloc( size_t nmemb, size_t size )
+/*
+ * \brief malloc_stats_get
+ *
+ * \param info where to store the current heap statistics
+ *
+ * \return none
+ */
+void malloc_stats_get( struct malloc_stats_info *info )
 {
-   size_t total_size = nmemb * size;
-   
-   void *ptr = malloc(total_size);
-   if (ptr)
-   {
-      memset(ptr, 0, total_size);
-   }
-   
-   return ptr;
+   mallocInit();
+
+   statsCollect(info);
 }
 
-void *realloc( void *ptr, size_t size )
+/*
+ * \brief malloc_stats
+ *
+ * Prints the heap statistics to stderr, like glibc does, followed by the
+ * latency tables when MALLOC_LATENCY is set.
+ *
+ * \return none
+ */
+void malloc_stats( void )
 {
-   if (ptr == NULL)
-   {
-      return malloc(size);
-   }
-   if (size == 0)
+   mallocInit();
+
+   statsWrite(STDERR_FILENO);
+   if (latency_on)
    {
-      free(ptr);
-      return NULL;
+      latencyWrite(STDERR_FILENO);
    }
+}
 
-   struct _block *curr = BLOCK_HEADER(ptr);
-   size_t old_size = curr->size;
+/*
+ * \brief malloc_latency_print
+ *
+ * \param fd where to write the latency tables, which stay empty unless
+ * MALLOC_LATENCY is set
+ *
+ * \return none
+ */
+void malloc_latency_print( int fd )
+{
+   mallocInit();
+
+   latencyWrite(fd);
+}
+
+/*
+ * \brief mallinfo2
+ *
+ * The heap statistics in the glibc format.  Slab memory counts as in use
+ * heap memory, and there are no fastbins.
+ *
+ * \return the statistics
+ */
+struct mallinfo2 mallinfo2( void )
+{
+   mallocInit();
+
+   struct malloc_stats_info st;
+   statsCollect(&st);
+
+   struct mallinfo2 mi = { 0 };
+   mi.arena    = st.heap_bytes + st.slab_bytes;
+   mi.ordblks  = st.free_blocks;
+   mi.hblks    = st.mmap_blocks;
+   mi.hblkhd   = st.mmap_bytes;
+   mi.uordblks = mi.arena - st.free_bytes;
+   mi.fordblks = st.free_bytes;
 
-   if (size <= old_size)
+   pthread_mutex_lock(&main_arena.lock);
+   if (main_arena.heapEnd)
    {
-      if (old_size - size >= sizeof(struct _block) + 4)
+      /* The wilderness, and the free _block before it */
+      mi.keepcost = main_arena.top - (char *)BLOCK_DATA(main_arena.heapEnd);
+      if (!(main_arena.heapEnd->size & BLOCK_PREV_INUSE))
       {
-         struct _block *split = (struct _block *)((char *)curr + size + sizeof(struct _block));
-         split->size = old_size - size - sizeof(struct _block);
-         split->next = curr->next;
-         split->prev = curr;
-         split->free = true;
-         curr->size = size;
-         curr->next = split;
-         num_splits++;
+         mi.keepcost += BLOCK_SIZE(BLOCK_PREV(main_arena.heapEnd)) + BLOCK_OVERHEAD;
       }
-
-      return ptr;
    }
+   pthread_mutex_unlock(&main_arena.lock);
 
-   void *new_ptr = malloc(size);
-   if (new_ptr)
-   {
-      memcpy(new_ptr, ptr, old_size);
-      free(ptr);
-   }
+   return mi;
+}
 
-   return new_ptr;
+/*
+ * \brief get_total_free_memory
+ *
+ * \return bytes in free _blocks across all arenas
+ */
+size_t get_total_free_memory( void )
+{
+   struct malloc_stats_info st;
+   malloc_stats_get(&st);
+
+   return st.free_bytes;
 }
 
+/*
+ * \brief get_largest_free_block
+ *
+ * \return size of the largest free _block in any arena
+ */
+size_t get_largest_free_block( void )
+{
+   struct malloc_stats_info st;
+   malloc_stats_get(&st);
+
+   return st.largest_free;
+}
 
 
 /* vim: IENTRTMzMjAgU3ByaW5nIDIwM001= ----------------------------------------*/
@@ -0,0 +1,32 @@
+#ifndef MALLOC_ARENA_H
+#define MALLOC_ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * User arenas, for data that dies all at once.  arena_alloc() bumps a
+ * pointer through heaps reserved for the arena alone, so an allocation
+ * costs a few instructions and there is nothing to free one by one:
+ * arena_reset() drops everything allocated since the arena was created
+ * or last reset, and arena_destroy() gives the arena back to the OS.
+ * Memory from an arena must not be passed to free() or realloc().  An
+ * arena is not locked, so one thread at a time may use it, and none of
+ * it shows up in the heap statistics.
+ */
+struct arena;
+
+struct arena *arena_create(void);
+void         *arena_alloc(struct arena *arena, size_t size);
+void         *arena_aligned_alloc(struct arena *arena, size_t alignment, size_t size);
+void          arena_reset(struct arena *arena);
+void          arena_destroy(struct arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef MALLOC_BATCH_H
+#define MALLOC_BATCH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bulk allocation of objects of one size.  malloc_batch() stores up to n
+ * pointers to objects of size bytes in ptrs and returns how many it
+ * allocated, which is less than n only when memory runs out.  The arena
+ * lock is taken once and the objects are cut out of a few contiguous
+ * regions, so a batch costs about as much as one malloc() per region.
+ * Every object is an ordinary allocation: free(), realloc() and
+ * malloc_usable_size() accept it.  free_batch() frees n pointers from
+ * anywhere, skipping NULL entries, with one lock per run of objects
+ * from the same arena.
+ */
+size_t malloc_batch(size_t size, void **ptrs, size_t n);
+void   free_batch(void **ptrs, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
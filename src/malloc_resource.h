@@ -0,0 +1,99 @@
+#ifndef MALLOC_RESOURCE_H
+#define MALLOC_RESOURCE_H
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "malloc_arena.h"
+
+extern "C" void *malloc_heap_alloc(unsigned int heap, std::size_t alignment,
+                                   std::size_t size);
+
+/*
+ * A std::pmr::memory_resource on top of the library's heaps, for pmr
+ * containers that should not go through whatever
+ * std::pmr::get_default_resource() was set to:
+ *
+ *    malloc_resource heap;
+ *    std::pmr::vector<int> v(&heap);
+ *
+ * A default malloc_resource allocates with the library's operator new,
+ * from the heap of whichever CPU the thread runs on.  malloc_resource(n)
+ * points containers at heap n (modulo MALLOC_ARENAS) instead, so data
+ * that is used together stays together and threads sharing it need not
+ * run on the same CPU.  Deallocation passes the size back, so small
+ * objects take the sized delete path.  Every malloc_resource frees the
+ * same way, so any one of them can free what another allocated.
+ *
+ * arena_resource points containers at a user arena instead, for data
+ * that is dropped all at once with arena_reset().  Deallocation does
+ * nothing, like std::pmr::monotonic_buffer_resource.
+ */
+class malloc_resource : public std::pmr::memory_resource
+{
+public:
+   malloc_resource() : heap_(-1) {}
+   explicit malloc_resource(unsigned int heap) : heap_(heap) {}
+
+protected:
+   void *do_allocate(std::size_t bytes, std::size_t alignment) override
+   {
+      if (heap_ < 0)
+      {
+         return ::operator new(bytes, std::align_val_t(alignment));
+      }
+
+      void *p = malloc_heap_alloc(heap_, alignment, bytes ? bytes : 1);
+      if (p == nullptr)
+      {
+         throw std::bad_alloc();
+      }
+      return p;
+   }
+
+   void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+   {
+      ::operator delete(p, bytes, std::align_val_t(alignment));
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      return dynamic_cast<const malloc_resource *>(&other) != nullptr;
+   }
+
+private:
+   long heap_;
+};
+
+class arena_resource : public std::pmr::memory_resource
+{
+public:
+   explicit arena_resource(struct arena *arena) : arena_(arena) {}
+
+protected:
+   void *do_allocate(std::size_t bytes, std::size_t alignment) override
+   {
+      void *p = arena_aligned_alloc(arena_, alignment, bytes);
+      if (p == nullptr)
+      {
+         throw std::bad_alloc();
+      }
+      return p;
+   }
+
+   void do_deallocate(void *, std::size_t, std::size_t) override
+   {
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      const arena_resource *r = dynamic_cast<const arena_resource *>(&other);
+      return r != nullptr && r->arena_ == arena_;
+   }
+
+private:
+   struct arena *arena_;
+};
+
+#endif
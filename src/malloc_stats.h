@@ -0,0 +1,68 @@
+#ifndef MALLOC_STATS_H
+#define MALLOC_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Live heap statistics.  malloc_stats_get() adds up the counters of every
+ * arena and thread when it is called, so a running process can watch
+ * them.  mallinfo2() and malloc_stats() from <malloc.h> report the same
+ * state in the glibc format.
+ *
+ * With MALLOC_LATENCY=1 in the environment every malloc, free, calloc and
+ * realloc is timed, and malloc_latency_print() writes p50, p99, p99.9
+ * and maximum latencies by path and by size to a file descriptor.  They
+ * are also printed to stderr at exit.
+ */
+struct malloc_stats_info
+{
+   /* Events since the process started */
+   uint64_t mallocs;
+   uint64_t frees;
+   uint64_t reuses;
+   uint64_t grows;         /* Calls to the OS for more heap                */
+   uint64_t carves;        /* Blocks carved from the heap top without one  */
+   uint64_t mmaps;
+   uint64_t inplace;       /* reallocs that grew without moving            */
+   uint64_t moves;         /* reallocs that moved the data                 */
+   uint64_t switches;      /* Adaptive policy phase changes                */
+   uint64_t slabs;         /* Slabs set up for small objects               */
+   uint64_t remote;        /* Frees passed to another arena's queue        */
+   uint64_t splits;
+   uint64_t coalesces;
+   uint64_t requested;     /* Bytes requested                              */
+   uint64_t max_heap;      /* Bytes the heaps grew by                      */
+   uint64_t trimmed;       /* Bytes given back to the OS from a heap top   */
+   uint64_t purged;        /* Bytes of free blocks and empty slabs
+                              dropped by malloc_trim                       */
+
+   /* Current state */
+   uint64_t blocks;        /* Blocks in the heaps, free or not             */
+   uint64_t heap_bytes;    /* Bytes the heaps hold now                     */
+   uint64_t slab_bytes;    /* Bytes of committed slab memory               */
+   uint64_t mmap_blocks;   /* Blocks with a mapping of their own           */
+   uint64_t mmap_bytes;    /* Bytes in those mappings                      */
+   uint64_t huge_bytes;    /* Committed heap bytes on huge pages, with
+                              MALLOC_HUGEPAGES                             */
+   uint64_t free_blocks;   /* Free blocks in the heaps                     */
+   uint64_t free_bytes;    /* Bytes in free blocks                         */
+   uint64_t largest_free;  /* Size of the largest free block               */
+   double   fragmentation; /* Share of free bytes outside the largest free
+                              block, from 0 to 1                           */
+};
+
+void   malloc_stats_get(struct malloc_stats_info *info);
+void   malloc_latency_print(int fd);
+size_t get_total_free_memory(void);
+size_t get_largest_free_block(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef MALLOC_TRACE_H
+#define MALLOC_TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Allocation traces.  With MALLOC_TRACE=<file> in the environment every
+ * malloc, free, calloc, realloc and aligned allocation is logged to the
+ * file, which is a malloc_trace_header followed by a ring of capacity
+ * events.  Event n goes to slot n % capacity, so once count passes
+ * capacity the oldest events are overwritten and the trace starts at
+ * slot count % capacity.  A "%p" in the file name is replaced by the
+ * process id.  tools/replay runs a trace against any allocator.
+ */
+#define MALLOC_TRACE_MAGIC  0x313045434152544DULL  /* "MTRACE01" */
+
+enum
+{
+   MALLOC_TRACE_MALLOC,    /* ptr = malloc(size)                          */
+   MALLOC_TRACE_FREE,      /* free(ptr)                                   */
+   MALLOC_TRACE_CALLOC,    /* ptr = calloc(), size is the product         */
+   MALLOC_TRACE_REALLOC,   /* ptr = realloc(arg, size)                    */
+   MALLOC_TRACE_MEMALIGN   /* ptr = aligned allocation, arg the alignment */
+};
+
+struct malloc_trace_header
+{
+   uint64_t magic;
+   uint64_t capacity;      /* Number of event slots                       */
+   uint64_t count;         /* Events logged, which may exceed capacity    */
+   uint64_t start;         /* CLOCK_REALTIME in ns when the trace was
+                              opened, which event times count from        */
+};
+
+struct malloc_trace_event
+{
+   uint64_t time;          /* ns since the trace started                  */
+   uint64_t ptr;           /* Pointer returned or freed, its id           */
+   uint64_t arg;           /* Old pointer or alignment, see above         */
+   uint64_t size;          /* Requested size in bytes                     */
+   uint32_t thread;        /* Kernel thread id                            */
+   uint32_t op;            /* MALLOC_TRACE_MALLOC ...                     */
+};
+
+#endif
@@ -0,0 +1,76 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/malloc_stats.h"
+
+#define LOOKUPS 3000
+
+static char *ptrs[LOOKUPS];
+
+int main(int argc, char **argv)
+{
+   /* The allocator reads the policy once, so come back with it set.  One
+      arena without slabs keeps every block in the same free lists. */
+   if (getenv("MALLOC_POLICY") == NULL)
+   {
+      setenv("MALLOC_POLICY", "adaptive", 1);
+      setenv("MALLOC_ARENAS", "1", 1);
+      setenv("MALLOC_SLABS", "0", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   /* Under glibc there is no adaptive policy to test */
+   void (*stats_get)(struct malloc_stats_info *) = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+   if (stats_get == NULL)
+   {
+      printf("adaptive test SKIPPED: no policies without the library\n");
+      return 0;
+   }
+
+   struct malloc_stats_info before, after;
+
+   /* Reusing most of a freed block leaves one small free block, which
+      holds all of the free space */
+   char *a = malloc(1000);
+   char *guard = malloc(1000);
+   assert(a && guard);
+   free(a);
+   char *b = malloc(880);
+   assert(b == a);
+
+   stats_get(&before);
+   assert(before.free_blocks == 1);
+   assert(before.largest_free == before.free_bytes);
+   assert(before.free_bytes < 512);
+
+   /* Requests it cannot serve go through the policy several windows over,
+      and the free space never splits up */
+   for (int i = 0; i < LOOKUPS; i++)
+   {
+      ptrs[i] = malloc(2000);
+      assert(ptrs[i]);
+      memset(ptrs[i], i, 2000);
+   }
+
+   stats_get(&after);
+   assert(after.free_blocks == 1);
+   assert(after.switches == before.switches);
+
+   for (int i = 0; i < LOOKUPS; i++)
+   {
+      free(ptrs[i]);
+   }
+   free(b);
+   free(guard);
+
+   printf("adaptive test PASSED\n");
+
+   return 0;
+}
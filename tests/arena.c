@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/malloc_arena.h"
+#include "../src/malloc_stats.h"
+
+#define COUNT 100000
+
+static char *objects[COUNT];
+
+int main()
+{
+   struct arena *(*create)(void) = dlsym(RTLD_DEFAULT, "arena_create");
+   void *(*alloc)(struct arena *, size_t) = dlsym(RTLD_DEFAULT, "arena_alloc");
+   void *(*aligned)(struct arena *, size_t, size_t) = dlsym(RTLD_DEFAULT, "arena_aligned_alloc");
+   void (*reset)(struct arena *) = dlsym(RTLD_DEFAULT, "arena_reset");
+   void (*destroy)(struct arena *) = dlsym(RTLD_DEFAULT, "arena_destroy");
+   void (*stats_get)(struct malloc_stats_info *) = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+
+   /* Under glibc there are no user arenas to test */
+   if (create == NULL || stats_get == NULL)
+   {
+      printf("arena test SKIPPED: no user arenas without the library\n");
+      return 0;
+   }
+
+   struct malloc_stats_info before, after;
+   stats_get(&before);
+
+   struct arena *arena = create();
+   assert(arena != NULL);
+
+   for (int round = 0; round < 3; round++)
+   {
+      /* Enough to fill more than one heap */
+      for (int i = 0; i < COUNT; i++)
+      {
+         size_t size = 1 + (i * 7919) % 1500;
+         objects[i] = alloc(arena, size);
+         assert(objects[i] != NULL);
+         assert(((uintptr_t)objects[i] & 15) == 0);
+         memset(objects[i], i & 0xff, size);
+      }
+      for (int i = 0; i < COUNT; i++)
+      {
+         size_t size = 1 + (i * 7919) % 1500;
+         assert(objects[i][0] == (char)(i & 0xff));
+         assert(objects[i][size - 1] == (char)(i & 0xff));
+      }
+
+      /* Aligned and large requests */
+      char *page = aligned(arena, 4096, 100);
+      assert(page != NULL && ((uintptr_t)page & 4095) == 0);
+      char *big = alloc(arena, 40 * 1024 * 1024);
+      assert(big != NULL);
+      memset(big, 'b', 40 * 1024 * 1024);
+      char *huge_aligned = aligned(arena, 32 * 1024 * 1024, 1000);
+      assert(huge_aligned != NULL && ((uintptr_t)huge_aligned & (32 * 1024 * 1024 - 1)) == 0);
+      huge_aligned[999] = 1;
+
+      /* After a reset the arena starts over */
+      char *first = objects[0];
+      reset(arena);
+      assert(alloc(arena, 1) == first);
+      reset(arena);
+   }
+
+   errno = 0;
+   assert(alloc(arena, SIZE_MAX) == NULL);
+   assert(errno == ENOMEM);
+   errno = 0;
+   assert(aligned(arena, 48, 16) == NULL);
+   assert(errno == EINVAL);
+
+   destroy(arena);
+   destroy(NULL);
+
+   /* None of it went through the heap */
+   stats_get(&after);
+   assert(after.mallocs == before.mallocs);
+   assert(after.frees == before.frees);
+   assert(after.max_heap == before.max_heap);
+   assert(after.mmap_blocks == before.mmap_blocks);
+
+   /* Arenas come and go without leaking */
+   for (int i = 0; i < 1000; i++)
+   {
+      arena = create();
+      assert(arena != NULL);
+      assert(alloc(arena, 100000) != NULL);
+      destroy(arena);
+   }
+
+   printf("arena test PASSED\n");
+
+   return 0;
+}
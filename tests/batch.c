@@ -0,0 +1,100 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/malloc_batch.h"
+#include "../src/malloc_stats.h"
+
+#define COUNT 10000
+
+static void *ptrs[COUNT];
+
+/* Allocates a batch and checks the objects are usable and do not overlap */
+static size_t fill(size_t (*batch)(size_t, void **, size_t), size_t size, size_t n)
+{
+   memset(ptrs, 0, sizeof(ptrs));
+   size_t done = batch(size, ptrs, n);
+   assert(done == n);
+
+   for (size_t i = 0; i < n; i++)
+   {
+      assert(ptrs[i] != NULL);
+      assert(((uintptr_t)ptrs[i] & 15) == 0);
+      assert(malloc_usable_size(ptrs[i]) >= size);
+      memset(ptrs[i], (int)i, size);
+   }
+   for (size_t i = 0; i < n; i++)
+   {
+      for (size_t k = 0; k < size; k++)
+      {
+         assert(((unsigned char *)ptrs[i])[k] == (unsigned char)i);
+      }
+   }
+   return done;
+}
+
+int main()
+{
+   size_t (*batch)(size_t, void **, size_t) = dlsym(RTLD_DEFAULT, "malloc_batch");
+   void (*batch_free)(void **, size_t) = dlsym(RTLD_DEFAULT, "free_batch");
+   void (*stats_get)(struct malloc_stats_info *) = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+
+   /* Under glibc there are no batch calls to test */
+   if (batch == NULL || batch_free == NULL || stats_get == NULL)
+   {
+      printf("batch test SKIPPED: no batch calls without the library\n");
+      return 0;
+   }
+
+   struct malloc_stats_info before, after;
+
+   /* Every object counts as a malloc and a free */
+   static const size_t sizes[] = { 24, 100, 512, 600, 4000, 70000 };
+   for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      stats_get(&before);
+      fill(batch, sizes[s], COUNT / 10);
+      stats_get(&after);
+      assert(after.mallocs == before.mallocs + COUNT / 10);
+      assert(after.requested >= before.requested + sizes[s] * (COUNT / 10));
+
+      batch_free(ptrs, COUNT / 10);
+      stats_get(&after);
+      assert(after.frees == before.frees + COUNT / 10);
+   }
+
+   /* Objects of a batch can be freed and resized one by one */
+   fill(batch, 48, COUNT);
+   for (size_t i = 0; i < COUNT; i += 2)
+   {
+      free(ptrs[i]);
+      ptrs[i] = NULL;
+   }
+   ptrs[1] = realloc(ptrs[1], 5000);
+   assert(ptrs[1] != NULL);
+   assert(((unsigned char *)ptrs[1])[47] == 1);
+   batch_free(ptrs, COUNT);
+
+   /* Large objects get mappings of their own */
+   stats_get(&before);
+   fill(batch, 1024 * 1024, 4);
+   stats_get(&after);
+   assert(after.mmap_blocks == before.mmap_blocks + 4);
+   batch_free(ptrs, 4);
+   stats_get(&after);
+   assert(after.mmap_blocks == before.mmap_blocks);
+
+   /* Nothing to do */
+   assert(batch(0, ptrs, 10) == 0);
+   assert(batch(64, ptrs, 0) == 0);
+   batch_free(ptrs, 0);
+
+   printf("batch test PASSED\n");
+
+   return 0;
+}
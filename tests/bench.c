@@ -0,0 +1,463 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+// Multi-threaded allocator benchmarks after the classic suites:
+//
+//   larson         server threads free and replace random objects, then
+//                  hand their objects on to the next generation of threads
+//   xmalloc        producers allocate, consumers on other threads free
+//   cache-scratch  each thread frees an object the main thread allocated
+//                  next to the others', then works on objects of its own
+//   cache-thrash   each thread allocates, writes and frees one object at
+//                  a time, looking for objects that share a cache line
+//   threadtest     each thread allocates a batch of objects, then frees it
+//
+// usage: bench workload [-t threads] [-s size] [-n iterations] [-h]
+//
+// Prints one CSV line (-h prints the header) with the allocation and free
+// calls per second, the peak RSS, the peak of live requested bytes and the
+// overhead: peak RSS growth beyond the live bytes.  Run it under
+// LD_PRELOAD to measure a library; `make bench` runs all of them.
+
+#define CSV_HEADER "workload,library,threads,size,iterations,seconds,ops_per_sec,peak_rss_kb,peak_live_kb,overhead_kb"
+
+#define LARSON_SLOTS 1000
+#define LARSON_ROUNDS 10
+#define XMALLOC_BATCH 64
+#define THREADTEST_OBJECTS 1000
+#define CACHE_WRITES 100
+
+static int threads = 1;
+static size_t size = 64;
+static long iterations = 0;
+
+static long live_bytes;   // Requested bytes not freed yet
+static long peak_bytes;
+static long total_ops;    // Calls to malloc and free
+
+// Threads add their allocations and frees up here every so often, so the
+// bookkeeping stays off the allocator's critical path
+struct tally
+{
+    long live;
+    long ops;
+};
+
+static void flush(struct tally *t)
+{
+    long live = __atomic_add_fetch(&live_bytes, t->live, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak &&
+           !__atomic_compare_exchange_n(&peak_bytes, &peak, live, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+    __atomic_add_fetch(&total_ops, t->ops, __ATOMIC_RELAXED);
+    t->live = 0;
+    t->ops = 0;
+}
+
+static void *bench_malloc(struct tally *t, size_t n)
+{
+    void *ptr = malloc(n);
+    if (ptr == NULL)
+    {
+        fprintf(stderr, "malloc(%zu) failed\n", n);
+        exit(1);
+    }
+    // Touch the object like a program would
+    *(volatile char *)ptr = 1;
+    t->live += n;
+    if (++t->ops % 256 == 0)
+    {
+        flush(t);
+    }
+    return ptr;
+}
+
+static void bench_free(struct tally *t, void *ptr, size_t n)
+{
+    free(ptr);
+    t->live -= n;
+    if (++t->ops % 256 == 0)
+    {
+        flush(t);
+    }
+}
+
+// Sizes from size / 2 to size * 3 / 2, so they cross size classes
+static size_t random_size(unsigned int *seed)
+{
+    return size / 2 + rand_r(seed) % (size + 1);
+}
+
+static void run_threads(void *(*worker)(void *), void **args)
+{
+    pthread_t tids[threads];
+
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_create(&tids[i], NULL, worker, args ? args[i] : (void *)(long)i);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(tids[i], NULL);
+    }
+}
+
+//
+// larson
+//
+struct larson_state
+{
+    void *slots[LARSON_SLOTS];
+    size_t sizes[LARSON_SLOTS];
+    unsigned int seed;
+};
+
+static void *larson_worker(void *arg)
+{
+    struct larson_state *s = arg;
+    struct tally t = { 0 };
+
+    for (long i = 0; i < iterations; i++)
+    {
+        int slot = rand_r(&s->seed) % LARSON_SLOTS;
+        bench_free(&t, s->slots[slot], s->sizes[slot]);
+        s->sizes[slot] = random_size(&s->seed);
+        s->slots[slot] = bench_malloc(&t, s->sizes[slot]);
+    }
+    flush(&t);
+
+    return NULL;
+}
+
+static void larson(void)
+{
+    struct larson_state *states[threads];
+    struct tally t = { 0 };
+
+    for (int i = 0; i < threads; i++)
+    {
+        states[i] = calloc(1, sizeof(struct larson_state));
+        states[i]->seed = i + 1;
+        for (int j = 0; j < LARSON_SLOTS; j++)
+        {
+            states[i]->sizes[j] = random_size(&states[i]->seed);
+            states[i]->slots[j] = bench_malloc(&t, states[i]->sizes[j]);
+        }
+    }
+    flush(&t);
+
+    // Every round is a new set of threads freeing what the last one left
+    for (int round = 0; round < LARSON_ROUNDS; round++)
+    {
+        run_threads(larson_worker, (void **)states);
+    }
+
+    for (int i = 0; i < threads; i++)
+    {
+        for (int j = 0; j < LARSON_SLOTS; j++)
+        {
+            bench_free(&t, states[i]->slots[j], states[i]->sizes[j]);
+        }
+        free(states[i]);
+    }
+    flush(&t);
+}
+
+//
+// xmalloc
+//
+struct batch
+{
+    struct batch *next;
+    void *objects[XMALLOC_BATCH];
+    size_t sizes[XMALLOC_BATCH];
+};
+
+static struct batch *batches;
+static int batches_queued;
+static int producers_left;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t batch_taken = PTHREAD_COND_INITIALIZER;
+
+static void *xmalloc_producer(void *arg)
+{
+    unsigned int seed = (unsigned int)(long)arg + 1;
+    struct tally t = { 0 };
+
+    for (long i = 0; i < iterations; i += XMALLOC_BATCH)
+    {
+        struct batch *b = bench_malloc(&t, sizeof(struct batch));
+        for (int j = 0; j < XMALLOC_BATCH; j++)
+        {
+            b->sizes[j] = random_size(&seed);
+            b->objects[j] = bench_malloc(&t, b->sizes[j]);
+        }
+
+        pthread_mutex_lock(&batch_lock);
+        while (batches_queued >= 4 * threads && threads > 1)
+        {
+            pthread_cond_wait(&batch_taken, &batch_lock);
+        }
+        b->next = batches;
+        batches = b;
+        batches_queued++;
+        pthread_cond_signal(&batch_ready);
+        pthread_mutex_unlock(&batch_lock);
+    }
+
+    pthread_mutex_lock(&batch_lock);
+    producers_left--;
+    pthread_cond_broadcast(&batch_ready);
+    pthread_mutex_unlock(&batch_lock);
+    flush(&t);
+
+    return NULL;
+}
+
+static void *xmalloc_consumer(void *arg)
+{
+    struct tally t = { 0 };
+
+    for (;;)
+    {
+        pthread_mutex_lock(&batch_lock);
+        while (batches == NULL && producers_left > 0)
+        {
+            pthread_cond_wait(&batch_ready, &batch_lock);
+        }
+        struct batch *b = batches;
+        if (b)
+        {
+            batches = b->next;
+            batches_queued--;
+            pthread_cond_signal(&batch_taken);
+        }
+        pthread_mutex_unlock(&batch_lock);
+
+        if (b == NULL)
+        {
+            break;
+        }
+        for (int j = 0; j < XMALLOC_BATCH; j++)
+        {
+            bench_free(&t, b->objects[j], b->sizes[j]);
+        }
+        bench_free(&t, b, sizeof(struct batch));
+    }
+    flush(&t);
+
+    return NULL;
+}
+
+// Even threads produce and odd ones consume, so one thread does both
+static void *xmalloc_worker(void *arg)
+{
+    if ((long)arg % 2 == 0)
+    {
+        xmalloc_producer(arg);
+        if (threads == 1)
+        {
+            xmalloc_consumer(arg);
+        }
+        return NULL;
+    }
+    return xmalloc_consumer(arg);
+}
+
+static void xmalloc(void)
+{
+    producers_left = (threads + 1) / 2;
+    run_threads(xmalloc_worker, NULL);
+}
+
+//
+// cache-scratch and cache-thrash
+//
+static void *cache_worker(void *arg)
+{
+    void **object = arg;
+    struct tally t = { 0 };
+
+    // cache-scratch hands each thread a neighbour of the others' objects
+    if (object)
+    {
+        bench_free(&t, *object, size);
+    }
+
+    for (long i = 0; i < iterations; i++)
+    {
+        volatile char *ptr = bench_malloc(&t, size);
+        for (int w = 0; w < CACHE_WRITES; w++)
+        {
+            for (size_t k = 0; k < size; k++)
+            {
+                ptr[k]++;
+            }
+        }
+        bench_free(&t, (void *)ptr, size);
+    }
+    flush(&t);
+
+    return NULL;
+}
+
+static void cache_scratch(void)
+{
+    void *objects[threads];
+    void *args[threads];
+    struct tally t = { 0 };
+
+    for (int i = 0; i < threads; i++)
+    {
+        objects[i] = bench_malloc(&t, size);
+        args[i] = &objects[i];
+    }
+    flush(&t);
+
+    run_threads(cache_worker, args);
+}
+
+static void cache_thrash(void)
+{
+    void *args[threads];
+
+    memset(args, 0, sizeof(args));
+    run_threads(cache_worker, args);
+}
+
+//
+// threadtest
+//
+static void *threadtest_worker(void *arg)
+{
+    void *objects[THREADTEST_OBJECTS];
+    struct tally t = { 0 };
+
+    for (long i = 0; i < iterations; i += THREADTEST_OBJECTS)
+    {
+        for (int j = 0; j < THREADTEST_OBJECTS; j++)
+        {
+            objects[j] = bench_malloc(&t, size);
+        }
+        for (int j = 0; j < THREADTEST_OBJECTS; j++)
+        {
+            bench_free(&t, objects[j], size);
+        }
+    }
+    flush(&t);
+
+    return NULL;
+}
+
+static void threadtest(void)
+{
+    run_threads(threadtest_worker, NULL);
+}
+
+static const struct
+{
+    const char *name;
+    void (*run)(void);
+    long iterations;   // Default per thread
+} workloads[] =
+{
+    { "larson",        larson,        200000 },
+    { "xmalloc",       xmalloc,       500000 },
+    { "cache-scratch", cache_scratch, 20000 },
+    { "cache-thrash",  cache_thrash,  20000 },
+    { "threadtest",    threadtest,    1000000 },
+};
+
+static long rss_kb(void)
+{
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%*s %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "t:s:n:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = atol(optarg);
+            break;
+        case 'h':
+            printf("%s\n", CSV_HEADER);
+            return 0;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    int w = -1;
+    for (int i = 0; optind == argc - 1 && i < (int)(sizeof(workloads) / sizeof(workloads[0])); i++)
+    {
+        if (strcmp(argv[optind], workloads[i].name) == 0)
+        {
+            w = i;
+        }
+    }
+    if (w < 0 || threads < 1 || size < 1)
+    {
+        fprintf(stderr, "usage: %s larson|xmalloc|cache-scratch|cache-thrash|threadtest "
+                "[-t threads] [-s size] [-n iterations] [-h]\n", argv[0]);
+        return 2;
+    }
+    if (iterations <= 0)
+    {
+        iterations = workloads[w].iterations;
+    }
+
+    long base_rss = rss_kb();
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    workloads[w].run();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peak_live = peak_bytes / 1024;
+    long overhead = usage.ru_maxrss - base_rss - peak_live;
+
+    const char *library = getenv("LD_PRELOAD");
+    printf("%s,%s,%d,%zu,%ld,%.3f,%.0f,%ld,%ld,%ld\n", workloads[w].name,
+           library && *library ? library : "glibc", threads, size, iterations,
+           seconds, total_ops / seconds, usage.ru_maxrss, peak_live,
+           overhead > 0 ? overhead : 0);
+
+    return 0;
+}
@@ -3,11 +3,20 @@
 #include <time.h>
 #include <string.h>
 #include <stdbool.h>
-#include "malloc.h" // Assuming your custom allocator implementation is in malloc.h and malloc.c
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dlfcn.h>
 
+#ifndef NUM_BLOCKS
 #define NUM_BLOCKS 1000
+#endif
 #define MAX_SIZE 1024
 #define MIN_SIZE 16
+#define OPS_PER_THREAD 200000
+#define THREAD_SLOTS 64
+#define MESSAGES_PER_PAIR 200000
+#define QUEUE_SLOTS 256
 
 void *blocks[NUM_BLOCKS];
 
@@ -16,13 +25,19 @@ void random_allocation_test();
 void sequential_growth_test();
 void fragmentation_test();
 void reallocation_stress_test();
+void threaded_scaling_test();
+void producer_consumer_test();
 
-// Functions to be implemented in malloc.c for tracking memory stats
-//size_t get_total_free_memory();
-//size_t get_largest_free_block();
+// Functions implemented in malloc.c for tracking memory stats, which only
+// the preloaded libraries have
+size_t (*get_total_free_memory)(void);
+size_t (*get_largest_free_block)(void);
 
 int main()
 {
+    get_total_free_memory = dlsym(RTLD_DEFAULT, "get_total_free_memory");
+    get_largest_free_block = dlsym(RTLD_DEFAULT, "get_largest_free_block");
+
     printf("\n--- Basic Stress Test ---\n");
     basic_stress_test();
 
@@ -38,6 +53,12 @@ int main()
     printf("\n--- Reallocation Stress Test ---\n");
     reallocation_stress_test();
 
+    printf("\n--- Threaded Scaling Test ---\n");
+    threaded_scaling_test();
+
+    printf("\n--- Producer Consumer Test ---\n");
+    producer_consumer_test();
+
     return 0;
 }
 
@@ -90,6 +111,10 @@ void random_allocation_test()
     clock_gettime(CLOCK_MONOTONIC, &end);
     double elapsed_time = ((end.tv_sec - start.tv_sec) * 1000.0) + ((end.tv_nsec - start.tv_nsec) / 1e6);
     printf("Elapsed time: %.2f milliseconds\n", elapsed_time);
+
+    // Per call latency should stay flat as NUM_BLOCKS grows
+    int calls = NUM_BLOCKS + NUM_BLOCKS + NUM_BLOCKS / 2;
+    printf("Average latency: %.1f nanoseconds per call\n", elapsed_time * 1e6 / calls);
 }
 
 void sequential_growth_test()
@@ -143,10 +168,14 @@ void fragmentation_test()
     printf("Elapsed time: %.2f milliseconds\n", elapsed_time);
 
     // Calculate fragmentation percentage using updated allocator info
-    //size_t total_free_memory = get_total_free_memory(); // Function to get total free memory
-    //size_t largest_free_block = get_largest_free_block(); // Function to get largest free block
+    size_t total_free_memory = get_total_free_memory ? get_total_free_memory() : 0;
+    size_t largest_free_block = get_largest_free_block ? get_largest_free_block() : 0;
 
-    /*if (total_free_memory > 0)
+    if (get_total_free_memory == NULL)
+    {
+        printf("Fragmentation statistics need one of the lib/ allocators preloaded.\n");
+    }
+    else if (total_free_memory > 0)
     {
         double fragmentation_percentage = (1.0 - ((double)largest_free_block / total_free_memory)) * 100.0;
         printf("Fragmentation Percentage: %.2f%%\n", fragmentation_percentage);
@@ -154,7 +183,7 @@ void fragmentation_test()
     else
     {
         printf("No free memory available.\n");
-    }*/
+    }
 
     if (new_large_block == NULL)
     {
@@ -192,3 +221,158 @@ void reallocation_stress_test()
         free(blocks[i]);
     }
 }
+
+void *scaling_worker(void *arg)
+{
+    unsigned int seed = (unsigned int)(long)arg;
+    void *slots[THREAD_SLOTS] = { 0 };
+
+    // Each thread churns through its own small working set
+    for (int i = 0; i < OPS_PER_THREAD; i++)
+    {
+        int slot = rand_r(&seed) % THREAD_SLOTS;
+        free(slots[slot]);
+        slots[slot] = malloc((rand_r(&seed) % (MAX_SIZE - MIN_SIZE + 1)) + MIN_SIZE);
+    }
+    for (int i = 0; i < THREAD_SLOTS; i++)
+    {
+        free(slots[i]);
+    }
+
+    return NULL;
+}
+
+void threaded_scaling_test()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    double base = 0;
+
+    for (long threads = 1; ; threads *= 2)
+    {
+        if (threads > cores)
+        {
+            threads = cores;
+        }
+
+        pthread_t tids[threads];
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (long i = 0; i < threads; i++)
+        {
+            pthread_create(&tids[i], NULL, scaling_worker, (void *)(i + 1));
+        }
+        for (long i = 0; i < threads; i++)
+        {
+            pthread_join(tids[i], NULL);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed_time = ((end.tv_sec - start.tv_sec) * 1000.0) + ((end.tv_nsec - start.tv_nsec) / 1e6);
+        double ops = threads * (double)OPS_PER_THREAD * 2 / (elapsed_time / 1000.0);
+        if (threads == 1)
+        {
+            base = ops;
+        }
+        printf("Threads: %ld\tThroughput: %.0f ops/sec\tSpeedup: %.2fx\n", threads, ops, ops / base);
+
+        if (threads == cores)
+        {
+            break;
+        }
+    }
+}
+
+// Single producer single consumer ring of message buffers
+struct message_queue
+{
+    void *slots[QUEUE_SLOTS];
+    unsigned long head; // Next slot the producer fills
+    unsigned long tail; // Next slot the consumer empties
+};
+
+void *producer(void *arg)
+{
+    struct message_queue *queue = arg;
+    unsigned int seed = (unsigned int)(long)queue;
+
+    // Every buffer is allocated here and freed by the consumer
+    for (unsigned long i = 0; i < MESSAGES_PER_PAIR; i++)
+    {
+        size_t size = (rand_r(&seed) % (MAX_SIZE - MIN_SIZE + 1)) + MIN_SIZE;
+        char *message = malloc(size);
+        message[0] = (char)i;
+
+        while (i - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) >= QUEUE_SLOTS)
+        {
+            sched_yield();
+        }
+        queue->slots[i % QUEUE_SLOTS] = message;
+        __atomic_store_n(&queue->head, i + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+void *consumer(void *arg)
+{
+    struct message_queue *queue = arg;
+
+    for (unsigned long i = 0; i < MESSAGES_PER_PAIR; i++)
+    {
+        while (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == i)
+        {
+            sched_yield();
+        }
+        char *message = queue->slots[i % QUEUE_SLOTS];
+        if (message[0] != (char)i)
+        {
+            printf("Message %lu corrupted\n", i);
+        }
+        free(message);
+        __atomic_store_n(&queue->tail, i + 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+void producer_consumer_test()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long max_pairs = cores / 2 > 0 ? cores / 2 : 1;
+
+    for (long pairs = 1; ; pairs *= 2)
+    {
+        if (pairs > max_pairs)
+        {
+            pairs = max_pairs;
+        }
+
+        pthread_t tids[2 * pairs];
+        struct message_queue *queues = calloc(pairs, sizeof(struct message_queue));
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        for (long i = 0; i < pairs; i++)
+        {
+            pthread_create(&tids[2 * i], NULL, producer, &queues[i]);
+            pthread_create(&tids[2 * i + 1], NULL, consumer, &queues[i]);
+        }
+        for (long i = 0; i < 2 * pairs; i++)
+        {
+            pthread_join(tids[i], NULL);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        free(queues);
+
+        double elapsed_time = ((end.tv_sec - start.tv_sec) * 1000.0) + ((end.tv_nsec - start.tv_nsec) / 1e6);
+        double messages = pairs * (double)MESSAGES_PER_PAIR / (elapsed_time / 1000.0);
+        printf("Pairs: %ld\tThroughput: %.0f messages/sec\n", pairs, messages);
+
+        if (pairs == max_pairs)
+        {
+            break;
+        }
+    }
+}
@@ -1,6 +1,22 @@
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <malloc.h>
+
+static int all_zero(const char *p, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (p[i] != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
 
 int main()
 {
@@ -14,9 +30,52 @@ int main()
     assert( array[3] == 0 );
     assert( array[4] == 0 );
 
-    printf("calloc test PASSED\n");
-
     free(array);
 
+    /* The product overflows */
+    volatile size_t huge = SIZE_MAX;
+    errno = 0;
+    assert( calloc(huge / 2, 3) == NULL );
+    assert( errno == ENOMEM );
+    errno = 0;
+    assert( calloc(huge, huge) == NULL );
+    assert( errno == ENOMEM );
+
+    /* Memory that was written and freed is cleared again */
+    for (size_t size = 16; size <= 64 * 1024; size *= 2)
+    {
+        char *dirty = malloc(size);
+        memset(dirty, 0xa5, size);
+        free(dirty);
+
+        char *p = calloc(1, size);
+        assert( p != NULL );
+        assert( all_zero(p, size) );
+        memset(p, 0x5a, size);
+        free(p);
+    }
+
+    /* A heap top that was given back and grown again */
+    char *top = malloc(200 * 1024);
+    memset(top, 0xa5, 200 * 1024);
+    free(top);
+    malloc_trim(0);
+    char *p = calloc(100, 1000);
+    assert( p != NULL );
+    assert( all_zero(p, 100 * 1000) );
+    free(p);
+
+    /* Large requests, also after the mmap threshold has moved up */
+    for (int i = 0; i < 4; i++)
+    {
+        char *big = calloc(1024, 1024);
+        assert( big != NULL );
+        assert( all_zero(big, 1024 * 1024) );
+        memset(big, 0xa5, 1024 * 1024);
+        free(big);
+    }
+
+    printf("calloc test PASSED\n");
+
     return (0);
 }
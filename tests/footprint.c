@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/malloc_stats.h"
+
+// Memory footprint over a long run.  A randomized workload goes through a
+// ramp-up and then cycles of steady churn, a burst and a release, with the
+// mix of object sizes changing from cycle to cycle.  Some objects live for
+// the whole run, so the releases leave holes behind.  Every -i calls the
+// program samples the RSS and the allocator's own view of its heap and
+// prints a CSV line, so the lines of one library form a time series.
+//
+// usage: footprint [-n calls] [-i interval] [-c cycles] [-m max_live_kb]
+//                  [-r seed] [-h]
+//
+// The libraries report their heap through malloc_stats_get(); glibc only
+// has mallinfo2(), which has no largest free block.  `make footprint`
+// runs every library.
+
+#define CSV_HEADER "library,call,phase,rss_kb,live_kb,heap_kb,max_heap_kb,free_kb,largest_free_kb,blocks"
+
+#define MAX_OBJECTS 65536
+#define SURVIVOR_PERCENT 5
+
+enum { RAMP_UP, CHURN, BURST, RELEASE };
+static const char *phase_names[] = { "ramp-up", "churn", "burst", "release" };
+
+// Share of calls that allocate in each phase, in percent
+static const int alloc_percent[] = { 60, 50, 90, 10 };
+
+struct object
+{
+    void *ptr;
+    size_t size;
+    int survivor;   // Never freed
+};
+
+static struct object objects[MAX_OBJECTS];
+static int live_index[MAX_OBJECTS];   // Objects that may be freed
+static int num_live;
+static int free_index[MAX_OBJECTS];   // Unused entries of objects
+static int num_free;
+static size_t live_bytes;
+
+static void (*stats_get)(struct malloc_stats_info *);
+static size_t peak_heap;
+
+static unsigned long long rng = 88172645463325252ULL;
+
+static unsigned long long next_random(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// Small, medium and large objects, weighted differently in every cycle
+static size_t pick_size(int cycle)
+{
+    static const int weights[][3] = { { 70, 25, 5 }, { 30, 60, 10 }, { 90, 8, 2 }, { 50, 30, 20 } };
+    const int *w = weights[cycle % 4];
+    unsigned int r = next_random() % 100;
+
+    if (r < (unsigned int)w[0])
+    {
+        return 16 + next_random() % 240;
+    }
+    if (r < (unsigned int)(w[0] + w[1]))
+    {
+        return 256 + next_random() % 8000;
+    }
+    return 8192 + next_random() % 57344;
+}
+
+static void allocate(int cycle, size_t max_live)
+{
+    if (num_free == 0 || live_bytes >= max_live)
+    {
+        return;
+    }
+
+    int i = free_index[--num_free];
+    objects[i].size = pick_size(cycle);
+    objects[i].ptr = malloc(objects[i].size);
+    if (objects[i].ptr == NULL)
+    {
+        fprintf(stderr, "malloc(%zu) failed\n", objects[i].size);
+        exit(1);
+    }
+    // Touch every page, so the RSS counts what a program would use
+    for (size_t k = 0; k < objects[i].size; k += 4096)
+    {
+        ((char *)objects[i].ptr)[k] = i;
+    }
+    live_bytes += objects[i].size;
+
+    objects[i].survivor = next_random() % 100 < SURVIVOR_PERCENT;
+    if (!objects[i].survivor)
+    {
+        live_index[num_live++] = i;
+    }
+}
+
+static void release(void)
+{
+    if (num_live == 0)
+    {
+        return;
+    }
+
+    int k = next_random() % num_live;
+    int i = live_index[k];
+    live_index[k] = live_index[--num_live];
+
+    free(objects[i].ptr);
+    live_bytes -= objects[i].size;
+    objects[i].ptr = NULL;
+    free_index[num_free++] = i;
+}
+
+static long rss_kb(void)
+{
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f)
+    {
+        if (fscanf(f, "%*s %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void sample(const char *library, long call, int phase)
+{
+    size_t heap, max_heap, free_bytes, largest_free, blocks;
+
+    if (stats_get)
+    {
+        struct malloc_stats_info st;
+        stats_get(&st);
+        heap = st.heap_bytes + st.slab_bytes + st.mmap_bytes;
+        max_heap = st.max_heap;
+        free_bytes = st.free_bytes;
+        largest_free = st.largest_free;
+        blocks = st.blocks + st.mmap_blocks;
+    }
+    else
+    {
+        struct mallinfo2 mi = mallinfo2();
+        heap = mi.arena + mi.hblkhd;
+        peak_heap = heap > peak_heap ? heap : peak_heap;
+        max_heap = peak_heap;
+        free_bytes = mi.fordblks;
+        largest_free = 0;
+        blocks = mi.ordblks + mi.hblks;
+    }
+
+    printf("%s,%ld,%s,%ld,%zu,%zu,%zu,%zu,%zu,%zu\n", library, call, phase_names[phase],
+           rss_kb(), live_bytes / 1024, heap / 1024, max_heap / 1024, free_bytes / 1024,
+           largest_free / 1024, blocks);
+}
+
+int main(int argc, char **argv)
+{
+    long calls = 1000000;
+    long interval = 10000;
+    int cycles = 5;
+    size_t max_live = 1024 * 1024 * 1024;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:i:c:m:r:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            calls = atol(optarg);
+            break;
+        case 'i':
+            interval = atol(optarg);
+            break;
+        case 'c':
+            cycles = atoi(optarg);
+            break;
+        case 'm':
+            max_live = strtoul(optarg, NULL, 0) * 1024;
+            break;
+        case 'r':
+            rng = strtoull(optarg, NULL, 0) | 1;
+            break;
+        case 'h':
+            printf("%s\n", CSV_HEADER);
+            return 0;
+        default:
+            calls = 0;
+            break;
+        }
+    }
+    // Every cycle needs at least one call after the ramp-up
+    if (calls < 1 || interval < 1 || cycles < 1 || calls - calls / 10 < cycles)
+    {
+        fprintf(stderr, "usage: %s [-n calls] [-i interval] [-c cycles] [-m max_live_kb] "
+                "[-r seed] [-h]\n", argv[0]);
+        return 2;
+    }
+
+    stats_get = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+    const char *library = getenv("LD_PRELOAD");
+    library = library && *library ? library : "glibc";
+
+    for (int i = 0; i < MAX_OBJECTS; i++)
+    {
+        free_index[num_free++] = MAX_OBJECTS - 1 - i;
+    }
+
+    // A tenth of the run ramps up, the rest is split evenly between the
+    // cycles: half churn, a fifth burst and the rest release
+    long ramp = calls / 10;
+    long cycle_calls = (calls - ramp) / cycles;
+
+    int phase = RAMP_UP;
+
+    for (long call = 0; call < calls; call++)
+    {
+        int cycle = 0;
+
+        if (call >= ramp)
+        {
+            long c = (call - ramp) % cycle_calls;
+            cycle = (call - ramp) / cycle_calls;
+            phase = c < cycle_calls / 2 ? CHURN
+                  : c < cycle_calls * 7 / 10 ? BURST : RELEASE;
+        }
+
+        if ((int)(next_random() % 100) < alloc_percent[phase])
+        {
+            allocate(cycle, max_live);
+        }
+        else
+        {
+            release();
+        }
+
+        if (call % interval == 0)
+        {
+            sample(library, call, phase);
+        }
+    }
+    sample(library, calls, phase);
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STEP  1000
+#define LIMIT (100 * 1024)
+
+int main()
+{
+   /* A buffer at the top of the heap grows without moving */
+   char *buf = malloc(STEP);
+   char *first = buf;
+   size_t size = STEP;
+   memset(buf, 0, size);
+
+   while (size + STEP < LIMIT)
+   {
+      buf = realloc(buf, size + STEP);
+      assert(buf == first);
+      memset(buf + size, (char)(size / STEP), STEP);
+      size += STEP;
+   }
+
+   for (size_t i = STEP; i < size; i++)
+   {
+      assert(buf[i] == (char)(i / STEP));
+   }
+
+   /* A free neighbour is absorbed */
+   char *a = malloc(1024);
+   char *b = malloc(1024);
+   char *c = malloc(1024);
+   assert(a && b && c);
+   free(b);
+   memset(a, 'a', 1024);
+   char *grown = realloc(a, 2048);
+   assert(grown == a);
+   for (int i = 0; i < 1024; i++)
+   {
+      assert(grown[i] == 'a');
+   }
+
+   /* Mapped _blocks keep their data through mremap */
+   char *big = malloc(256 * 1024);
+   memset(big, 'm', 256 * 1024);
+   big = realloc(big, 8 * 1024 * 1024);
+   assert(big);
+   for (int i = 0; i < 256 * 1024; i++)
+   {
+      assert(big[i] == 'm');
+   }
+
+   free(big);
+   free(grown);
+   free(c);
+   free(buf);
+
+   printf("grow test PASSED\n");
+
+   return 0;
+}
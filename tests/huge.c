@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/malloc_stats.h"
+
+#define HUGE_PAGE (2 * 1024 * 1024)
+#define COUNT     20000
+#define SIZE      4000
+
+static char *ptrs[COUNT];
+
+/* Sums a field of /proc/self/smaps in kB, without stdio buffers in the
+   heap under test */
+static long smaps_kb(const char *field)
+{
+   static char text[1 << 20];
+   size_t len = 0;
+   long total = 0;
+
+   int fd = open("/proc/self/smaps", O_RDONLY);
+   if (fd < 0)
+   {
+      return -1;
+   }
+   ssize_t n;
+   while (len < sizeof(text) - 1 && (n = read(fd, text + len, sizeof(text) - 1 - len)) > 0)
+   {
+      len += n;
+   }
+   close(fd);
+   text[len] = '\0';
+
+   for (char *p = strstr(text, field); p; p = strstr(p + 1, field))
+   {
+      total += atol(p + strlen(field));
+   }
+   return total;
+}
+
+int main(int argc, char **argv)
+{
+   /* The allocator reads the switch once, so come back with it set */
+   if (getenv("MALLOC_HUGEPAGES") == NULL)
+   {
+      setenv("MALLOC_HUGEPAGES", "thp", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   /* Under glibc there is no extended query, and the checks that need it
+      are skipped */
+   void (*stats_get)(struct malloc_stats_info *) = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+   struct malloc_stats_info st;
+   uint64_t committed = 0;
+
+   for (int i = 0; i < COUNT; i++)
+   {
+      ptrs[i] = malloc(SIZE);
+      assert(ptrs[i]);
+      memset(ptrs[i], i, SIZE);
+   }
+
+   if (stats_get)
+   {
+      /* The heap is committed in whole huge pages */
+      stats_get(&st);
+      assert(st.huge_bytes >= (uint64_t)COUNT * SIZE);
+      assert(st.huge_bytes % HUGE_PAGE == 0);
+      committed = st.huge_bytes;
+   }
+   long backed = smaps_kb("AnonHugePages:");
+
+   /* A block larger than a heap still works */
+   char *big = malloc(100 * 1024 * 1024);
+   assert(big);
+   big[100 * 1024 * 1024 - 1] = 1;
+   free(big);
+
+   for (int i = 0; i < COUNT; i++)
+   {
+      assert(ptrs[i][SIZE - 1] == (char)i);
+      free(ptrs[i]);
+   }
+   malloc_trim(0);
+
+   if (stats_get)
+   {
+      /* Trimming keeps whole huge pages */
+      stats_get(&st);
+      assert(st.huge_bytes < committed);
+      assert(st.huge_bytes % HUGE_PAGE == 0);
+   }
+
+   /* Only now, so stdio buffers do not pin the top of the heap */
+   printf("huge pages: %llu kB committed, %ld kB backed\n",
+          (unsigned long long)committed / 1024, backed);
+   printf("huge test PASSED\n");
+
+   return 0;
+}
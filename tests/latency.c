@@ -0,0 +1,67 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/malloc_stats.h"
+
+int main(int argc, char **argv)
+{
+   /* The allocator reads the switch once, so come back with it set */
+   if (getenv("MALLOC_LATENCY") == NULL)
+   {
+      setenv("MALLOC_LATENCY", "1", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   /* Under glibc there are no tables, and only the calls are made */
+   void (*latency_print)(int) = dlsym(RTLD_DEFAULT, "malloc_latency_print");
+
+   void *ptrs[100];
+   for (int round = 0; round < 100; round++)
+   {
+      for (int i = 0; i < 100; i++)
+      {
+         ptrs[i] = malloc(i * 97 + 1);
+         assert(ptrs[i]);
+      }
+      for (int i = 0; i < 100; i++)
+      {
+         ptrs[i] = realloc(ptrs[i], i * 193 + 1);
+         assert(ptrs[i]);
+      }
+      for (int i = 0; i < 100; i++)
+      {
+         free(ptrs[i]);
+      }
+      free(calloc(10, 100));
+   }
+
+   if (latency_print)
+   {
+      FILE *f = tmpfile();
+      assert(f);
+      latency_print(fileno(f));
+
+      char text[16384];
+      rewind(f);
+      size_t len = fread(text, 1, sizeof(text) - 1, f);
+      text[len] = '\0';
+      fclose(f);
+
+      assert(strstr(text, "malloc latency"));
+      assert(strstr(text, "realloc latency"));
+      assert(strstr(text, "p99.9"));
+      assert(strstr(text, "<= 16 "));
+      assert(strstr(text, "cache"));
+   }
+
+   printf("latency test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,82 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define ALIGNED(p, n) (((uintptr_t)(p) & ((n) - 1)) == 0)
+
+int main()
+{
+   /* Plain malloc is aligned for any type, at every size */
+   static const size_t sizes[] = { 1, 8, 16, 24, 40, 100, 256, 500, 1000,
+                                   4096, 100000, 1024 * 1024 };
+   void *ptrs[sizeof(sizes) / sizeof(sizes[0])];
+
+   for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+   {
+      ptrs[i] = malloc(sizes[i]);
+      assert(ptrs[i] && ALIGNED(ptrs[i], 16));
+      assert(malloc_usable_size(ptrs[i]) >= sizes[i]);
+      memset(ptrs[i], 'x', malloc_usable_size(ptrs[i]));
+   }
+   for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+   {
+      free(ptrs[i]);
+   }
+
+   /* Every alignment, in the heap and in mappings */
+   for (size_t align = 32; align <= 1024 * 1024; align *= 2)
+   {
+      for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      {
+         void *p = NULL;
+         assert(posix_memalign(&p, align, sizes[i]) == 0);
+         assert(p && ALIGNED(p, align));
+         assert(malloc_usable_size(p) >= sizes[i]);
+         memset(p, 'a', sizes[i]);
+         ptrs[i] = p;
+      }
+      for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      {
+         free(ptrs[i]);
+      }
+   }
+
+   /* Aligned memory can be reallocated like any other */
+   char *r = aligned_alloc(256, 1000);
+   assert(r && ALIGNED(r, 256));
+   memset(r, 'r', 1000);
+   char *grown = realloc(r, 50000);
+   assert(grown);
+   for (int i = 0; i < 1000; i++)
+   {
+      assert(grown[i] == 'r');
+   }
+   free(grown);
+
+   void *m = memalign(4096, 10);
+   assert(m && ALIGNED(m, 4096));
+   free(m);
+
+   void *v = valloc(100);
+   assert(v && ALIGNED(v, sysconf(_SC_PAGESIZE)));
+   free(v);
+
+   /* Bad alignments */
+   void *p = NULL;
+   assert(posix_memalign(&p, 24, 100) == EINVAL);
+   assert(posix_memalign(&p, 4, 100) == EINVAL);
+   errno = 0;
+   assert(aligned_alloc(48, 100) == NULL && errno == EINVAL);
+
+   assert(malloc_usable_size(NULL) == 0);
+
+   printf("memalign test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,51 @@
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define LARGE (1024 * 1024)
+
+int main()
+{
+   /* Large requests come from their own mapping, away from the heap */
+   char *small = malloc(64);
+   char *large = malloc(LARGE);
+   assert(small && large);
+
+   memset(large, 'x', LARGE);
+   assert(large[0] == 'x' && large[LARGE - 1] == 'x');
+
+   /* Shrinking keeps the mapping but unmaps its tail, growing moves the
+      data */
+   char *tail = (char *)(((uintptr_t)large + LARGE - 1) & ~(uintptr_t)4095);
+   unsigned char vec;
+   char *same = realloc(large, LARGE / 2);
+   assert(same == large);
+   assert(mincore(tail, 4096, &vec) == -1 && errno == ENOMEM);
+   large = realloc(same, 2 * LARGE);
+   assert(large && large[LARGE / 2 - 1] == 'x');
+
+   /* Below the mmap threshold the data moves into the heap */
+   char *moved = realloc(large, 100);
+   assert(moved && moved[0] == 'x' && moved[99] == 'x');
+   free(moved);
+
+   /* A fixed threshold sends everything above it to mmap */
+   assert(mallopt(M_MMAP_THRESHOLD, 4096) == 1);
+   char *page = malloc(8192);
+   assert(page);
+   memset(page, 'y', 8192);
+   free(page);
+
+   assert(mallopt(M_MMAP_THRESHOLD, -1) == 0);
+
+   free(small);
+
+   printf("mmap test PASSED\n");
+
+   return 0;
+}
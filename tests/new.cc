@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+#include <vector>
+
+#include "../src/malloc_resource.h"
+#include "../src/malloc_stats.h"
+
+struct alignas(64) line
+{
+   char bytes[64];
+};
+
+static int handler_calls = 0;
+
+static void handler()
+{
+   handler_calls++;
+   std::set_new_handler(nullptr);
+}
+
+int main()
+{
+   struct malloc_stats_info before, after;
+
+   /* new and delete come from the library */
+   malloc_stats_get(&before);
+   int *i = new int(42);
+   int *a = new int[100];
+   assert(*i == 42);
+   assert(malloc_usable_size(a) >= 100 * sizeof(int));
+   malloc_stats_get(&after);
+   assert(after.mallocs >= before.mallocs + 2);
+   delete i;
+   delete[] a;
+   malloc_stats_get(&after);
+   assert(after.frees >= before.frees + 2);
+
+   /* Sized delete, for every small size */
+   std::vector<void *> objects;
+   for (size_t size = 1; size <= 1024; size++)
+   {
+      objects.push_back(::operator new(size));
+   }
+   for (size_t size = 1; size <= 1024; size++)
+   {
+      ::operator delete(objects[size - 1], size);
+   }
+
+   /* Over-aligned types */
+   line *l = new line;
+   line *ls = new line[10];
+   assert(((uintptr_t)l & 63) == 0);
+   assert(((uintptr_t)ls & 63) == 0);
+   delete l;
+   delete[] ls;
+
+   void *page = ::operator new(100, std::align_val_t(4096));
+   assert(((uintptr_t)page & 4095) == 0);
+   ::operator delete(page, 100, std::align_val_t(4096));
+
+   /* new of 0 bytes gives distinct objects */
+   void *z1 = ::operator new(0);
+   void *z2 = ::operator new(0);
+   assert(z1 && z2 && z1 != z2);
+   ::operator delete(z1);
+   ::operator delete(z2);
+
+   /* Failures */
+   volatile size_t huge = SIZE_MAX / 2;
+   assert(::operator new(huge, std::nothrow) == nullptr);
+   assert(::operator new(huge, std::align_val_t(64), std::nothrow) == nullptr);
+
+   bool thrown = false;
+   try
+   {
+      void *p = ::operator new(huge);
+      ::operator delete(p);
+   }
+   catch (const std::bad_alloc &)
+   {
+      thrown = true;
+   }
+   assert(thrown);
+
+   std::set_new_handler(handler);
+   thrown = false;
+   try
+   {
+      void *p = ::operator new(huge);
+      ::operator delete(p);
+   }
+   catch (const std::bad_alloc &)
+   {
+      thrown = true;
+   }
+   assert(thrown);
+   assert(handler_calls == 1);
+
+   /* pmr containers */
+   malloc_resource heap;
+   malloc_resource other;
+   assert(heap.is_equal(other));
+   {
+      std::pmr::vector<int> v(&heap);
+      for (int k = 0; k < 100000; k++)
+      {
+         v.push_back(k);
+      }
+      assert(v[99999] == 99999);
+
+      std::pmr::vector<line> lines(100, &heap);
+      assert(((uintptr_t)lines.data() & 63) == 0);
+   }
+
+   /* pmr containers on one heap */
+   malloc_resource first(0);
+   malloc_resource second(1);
+   assert(first.is_equal(heap) && second.is_equal(first));
+   {
+      std::pmr::vector<int> v(&second);
+      for (int k = 0; k < 100000; k++)
+      {
+         v.push_back(k);
+      }
+      assert(v[99999] == 99999);
+      assert(malloc_usable_size(v.data()) >= 100000 * sizeof(int));
+
+      std::pmr::vector<line> lines(100, &first);
+      assert(((uintptr_t)lines.data() & 63) == 0);
+      lines.resize(1000);
+      assert(((uintptr_t)lines.data() & 63) == 0);
+   }
+
+   printf("new test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../src/malloc_stats.h"
+
+#define HEAP_SIZE (64UL * 1024 * 1024)
+#define COUNT     2000
+#define SIZE      4000
+
+static char *ptrs[COUNT];
+
+static void fill(void)
+{
+   for (int i = 0; i < COUNT; i++)
+   {
+      ptrs[i] = malloc(SIZE);
+      assert(ptrs[i]);
+      memset(ptrs[i], i, SIZE);
+   }
+}
+
+static void drain(void)
+{
+   for (int i = COUNT - 1; i >= 0; i--)
+   {
+      assert(ptrs[i][0] == (char)i && ptrs[i][SIZE - 1] == (char)i);
+      free(ptrs[i]);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   /* Under glibc there is no extended query, and the checks that need it
+      are skipped */
+   void (*stats_get)(struct malloc_stats_info *) = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+   struct malloc_stats_info st;
+
+   /* With one arena every request goes to the main arena, whatever CPU
+      the thread runs on */
+   const char *arenas = getenv("MALLOC_ARENAS");
+   if (arenas == NULL || strcmp(arenas, "1") != 0)
+   {
+      setenv("MALLOC_ARENAS", "1", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   if (getenv("MALLOC_PAGES") == NULL)
+   {
+      /* A mapping right at the break keeps it from moving, and the
+         main arena carries on in heaps */
+      free(malloc(SIZE));
+      char *brk = sbrk(0);
+      void *wall = mmap(brk, 4096, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+      assert(wall == brk);
+
+      fill();
+      assert((char *)sbrk(0) == brk);
+      drain();
+      munmap(wall, 4096);
+
+      /* The allocator reads the source once, so come back with it set */
+      setenv("MALLOC_PAGES", "mmap", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   char *brk = sbrk(0);
+   fill();
+
+   if (stats_get)
+   {
+      /* The main arena never touches the break, and its heaps are
+         contiguous, aligned ranges */
+      assert((char *)sbrk(0) == brk);
+      for (int i = 1; i < COUNT; i++)
+      {
+         uintptr_t heap = (uintptr_t)ptrs[i] & ~(HEAP_SIZE - 1);
+         assert(heap == ((uintptr_t)ptrs[i - 1] & ~(HEAP_SIZE - 1)) ||
+                (uintptr_t)ptrs[i] - heap < 4096);
+      }
+      stats_get(&st);
+   }
+
+   /* A block larger than a heap still works */
+   char *big = malloc(2 * HEAP_SIZE);
+   assert(big);
+   big[2 * HEAP_SIZE - 1] = 1;
+   free(big);
+
+   drain();
+   malloc_trim(0);
+
+   if (stats_get)
+   {
+      /* Freed heap pages go back to the OS */
+      uint64_t before = st.heap_bytes;
+      stats_get(&st);
+      assert(st.heap_bytes < before);
+      assert(st.trimmed > 0);
+   }
+
+   printf("pages test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ROUNDS 1000
+#define LIVE   64
+
+/* The traced run: every kind of event, with some memory still live at exit */
+static int record(void)
+{
+   static void *live[LIVE];
+
+   for (int i = 0; i < ROUNDS; i++)
+   {
+      char *a = malloc(1 + i % 300);
+      char *b = calloc(1 + i % 7, 40);
+      void *c = NULL;
+      assert(posix_memalign(&c, 64, 100 + i % 1000) == 0);
+      assert(a && b && c);
+
+      a = realloc(a, 2000 + i);
+      assert(a);
+
+      free(live[i % LIVE]);
+      live[i % LIVE] = a;
+      free(b);
+      free(c);
+   }
+
+   return 0;
+}
+
+/* Replays the trace at path, with extra as the -l option or NULL, and
+   returns the number of events tools/replay reports */
+static uint64_t replay(const char *path, const char *extra)
+{
+   char command[256];
+   snprintf(command, sizeof(command), "tools/replay %s %s", extra ? extra : "", path);
+
+   FILE *p = popen(command, "r");
+   assert(p);
+
+   char line[256];
+   uint64_t events = 0, lost = 1, unmatched = 1;
+   while (fgets(line, sizeof(line), p))
+   {
+      sscanf(line, "Events: %" SCNu64 " (%" SCNu64 " lost to the ring, %" SCNu64,
+             &events, &lost, &unmatched);
+   }
+
+   int status = pclose(p);
+   assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   assert(lost == 0 && unmatched == 0);
+
+   return events;
+}
+
+int main(int argc, char **argv)
+{
+   if (argc > 1 && strcmp(argv[1], "record") == 0)
+   {
+      return record();
+   }
+
+   /* Under glibc nothing writes a trace */
+   if (dlsym(RTLD_DEFAULT, "malloc_stats_get") == NULL)
+   {
+      printf("replay test SKIPPED: no traces without the library\n");
+      return 0;
+   }
+
+   if (access("tools/replay", X_OK) != 0)
+   {
+      fprintf(stderr, "replay test: run it from the top directory after make tools/replay\n");
+      return 1;
+   }
+
+   /* Record in a process of its own, so the trace is complete before it
+      is replayed */
+   char path[64];
+   snprintf(path, sizeof(path), "/tmp/malloc-replay-test.%d", (int)getpid());
+
+   pid_t pid = fork();
+   assert(pid >= 0);
+   if (pid == 0)
+   {
+      char *args[] = { argv[0], "record", NULL };
+      setenv("MALLOC_TRACE", path, 1);
+      execv("/proc/self/exe", args);
+      perror("execv");
+      _exit(1);
+   }
+
+   int status;
+   assert(waitpid(pid, &status, 0) == pid);
+   assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+   /* The same events replay against the library under test and glibc */
+   uint64_t events = replay(path, NULL);
+   assert(events >= 6 * ROUNDS);
+   assert(replay(path, "-l glibc") == events);
+
+   unlink(path);
+
+   printf("replay test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,68 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../src/malloc_arena.h"
+#include "../src/malloc_resource.h"
+
+struct alignas(64) line
+{
+   char bytes[64];
+};
+
+int main()
+{
+   struct arena *arena = arena_create();
+   assert(arena != nullptr);
+
+   arena_resource scratch(arena);
+   arena_resource same(arena);
+   malloc_resource heap;
+   assert(scratch.is_equal(same));
+   assert(!scratch.is_equal(heap) && !heap.is_equal(scratch));
+
+   for (int round = 0; round < 3; round++)
+   {
+      /* Containers on the arena, dropped with one reset */
+      {
+         std::pmr::vector<int> v(&scratch);
+         for (int k = 0; k < 100000; k++)
+         {
+            v.push_back(k);
+         }
+         assert(v[0] == 0 && v[99999] == 99999);
+
+         std::pmr::vector<line> lines(1000, &scratch);
+         assert(((uintptr_t)lines.data() & 63) == 0);
+         memset(lines.data(), round, lines.size() * sizeof(line));
+
+         std::pmr::vector<std::pmr::string> words(&scratch);
+         for (int k = 0; k < 1000; k++)
+         {
+            words.emplace_back(100, (char)('a' + k % 26));
+         }
+         assert(words[999].size() == 100 && words[999][0] == 'a' + 999 % 26);
+      }
+
+      arena_reset(arena);
+   }
+
+   /* Another arena does not share the memory */
+   struct arena *other = arena_create();
+   assert(other != nullptr);
+   arena_resource elsewhere(other);
+   assert(!scratch.is_equal(elsewhere));
+
+   arena_destroy(other);
+   arena_destroy(arena);
+
+   printf("resource test PASSED\n");
+
+   return 0;
+}
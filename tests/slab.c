@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_OBJECTS (1000 * 1000)
+#define OBJECT_SIZE 16
+
+/* Resident set size in bytes */
+static long rss(void)
+{
+   long size = 0, pages = 0;
+   FILE *f = fopen("/proc/self/statm", "r");
+   if (f)
+   {
+      int n = fscanf(f, "%ld %ld", &size, &pages);
+      assert(n == 2);
+      fclose(f);
+   }
+   return pages * sysconf(_SC_PAGESIZE);
+}
+
+int main()
+{
+   /* The table itself comes from mmap, so it is not part of the count */
+   char **objects = malloc(NUM_OBJECTS * sizeof(char *));
+   assert(objects);
+   memset(objects, 0, NUM_OBJECTS * sizeof(char *));
+
+   long before = rss();
+
+   for (int i = 0; i < NUM_OBJECTS; i++)
+   {
+      objects[i] = malloc(OBJECT_SIZE);
+      assert(objects[i]);
+      memset(objects[i], (char)i, OBJECT_SIZE);
+   }
+
+   long used = rss() - before;
+
+   for (int i = 0; i < NUM_OBJECTS; i++)
+   {
+      for (int k = 0; k < OBJECT_SIZE; k++)
+      {
+         assert(objects[i][k] == (char)i);
+      }
+   }
+
+   /* Slab objects sit back to back; with a header per object each one
+      costs OBJECT_SIZE plus a struct _block, more than three times as much.
+      Slabs must at least halve that. */
+   long gap = labs(objects[1] - objects[0]);
+   printf("%.1f bytes per %d byte object\n", (double)used / NUM_OBJECTS, OBJECT_SIZE);
+   if (gap == OBJECT_SIZE)
+   {
+      assert(used < (long)NUM_OBJECTS * OBJECT_SIZE * 2);
+   }
+
+   for (int i = 0; i < NUM_OBJECTS; i++)
+   {
+      free(objects[i]);
+   }
+
+   /* Trimming gives the pages of the empty slabs back, and they are
+      reused afterwards */
+   malloc_trim(0);
+   if (gap == OBJECT_SIZE)
+   {
+      assert(rss() - before < used / 2);
+   }
+
+   for (int i = 0; i < NUM_OBJECTS; i++)
+   {
+      objects[i] = malloc(OBJECT_SIZE);
+      assert(objects[i]);
+      memset(objects[i], (char)i, OBJECT_SIZE);
+   }
+   for (int i = 0; i < NUM_OBJECTS; i++)
+   {
+      assert(objects[i][0] == (char)i && objects[i][OBJECT_SIZE - 1] == (char)i);
+      free(objects[i]);
+   }
+   free(objects);
+
+   printf("slab test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/malloc_stats.h"
+
+#define BIG (4 * 1024 * 1024)
+
+int main()
+{
+   /* Under glibc there is no extended query, and the checks that need it
+      are skipped */
+   void (*stats_get)(struct malloc_stats_info *) = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+
+   /* Mapped blocks come and go */
+   struct mallinfo2 before = mallinfo2();
+   char *big = malloc(BIG);
+   assert(big);
+   memset(big, 'b', BIG);
+   struct mallinfo2 during = mallinfo2();
+   assert(during.hblks == before.hblks + 1);
+   assert(during.hblkhd >= before.hblkhd + BIG);
+   free(big);
+   struct mallinfo2 after = mallinfo2();
+   assert(after.hblks == before.hblks);
+   assert(after.hblkhd == before.hblkhd);
+
+   /* A hole shows up as free space */
+   char *a = malloc(4000);
+   char *b = malloc(4000);
+   char *c = malloc(4000);
+   assert(a && b && c);
+   before = mallinfo2();
+   free(b);
+   after = mallinfo2();
+   assert(after.fordblks >= before.fordblks + 4000);
+   assert(after.ordblks >= 1);
+   assert(after.uordblks + after.fordblks == after.arena);
+
+   if (stats_get)
+   {
+      struct malloc_stats_info st;
+      stats_get(&st);
+      assert(st.largest_free >= 4000);
+      assert(st.free_bytes >= st.largest_free);
+      assert(st.fragmentation >= 0.0 && st.fragmentation <= 1.0);
+
+      /* The counters do not wrap at 2 GB */
+      uint64_t requested = st.requested;
+      for (int i = 0; i < 3000; i++)
+      {
+         void *p = malloc(1024 * 1024);
+         assert(p);
+         free(p);
+      }
+      stats_get(&st);
+      assert(st.requested >= requested + 3000ULL * 1024 * 1024);
+   }
+
+   free(a);
+   free(c);
+
+   printf("stats test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,85 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_THREADS 8
+#define NUM_SLOTS   256
+#define NUM_ROUNDS  20000
+
+/* Blocks handed from one thread to the next so they are freed remotely */
+static char *shared[NUM_THREADS];
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg)
+{
+   int id = (int)(long)arg;
+   unsigned int seed = id;
+   char *slots[NUM_SLOTS] = { 0 };
+   size_t sizes[NUM_SLOTS];
+
+   for (int round = 0; round < NUM_ROUNDS; round++)
+   {
+      int i = rand_r(&seed) % NUM_SLOTS;
+
+      if (slots[i])
+      {
+         for (size_t k = 0; k < sizes[i]; k++)
+         {
+            assert(slots[i][k] == (char)(id + i));
+         }
+
+         if (rand_r(&seed) % 4 == 0)
+         {
+            /* Pass the block on and free whatever the last thread left */
+            pthread_mutex_lock(&shared_lock);
+            char *old = shared[id];
+            shared[id] = slots[i];
+            pthread_mutex_unlock(&shared_lock);
+            free(old);
+         }
+         else
+         {
+            free(slots[i]);
+         }
+         slots[i] = NULL;
+      }
+      else
+      {
+         sizes[i] = rand_r(&seed) % 2 ? rand_r(&seed) % 128 + 1 : rand_r(&seed) % 4096 + 1;
+         slots[i] = malloc(sizes[i]);
+         assert(slots[i] != NULL);
+         memset(slots[i], id + i, sizes[i]);
+      }
+   }
+
+   for (int i = 0; i < NUM_SLOTS; i++)
+   {
+      free(slots[i]);
+   }
+
+   return NULL;
+}
+
+int main()
+{
+   pthread_t threads[NUM_THREADS];
+
+   for (int i = 0; i < NUM_THREADS; i++)
+   {
+      pthread_create(&threads[i], NULL, worker, (void *)(long)i);
+   }
+   for (int i = 0; i < NUM_THREADS; i++)
+   {
+      pthread_join(threads[i], NULL);
+   }
+   for (int i = 0; i < NUM_THREADS; i++)
+   {
+      free(shared[i]);
+   }
+
+   printf("threads test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,92 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/malloc_stats.h"
+
+#define GROW_STEP (1024 * 1024)
+#define COUNT     1000
+#define SIZE      4000
+
+static char *ptrs[COUNT];
+
+int main(int argc, char **argv)
+{
+   /* The allocator reads the step once, so come back with it set.  One
+      arena keeps every request on the sbrk heap, whatever CPU the thread
+      runs on. */
+   const char *arenas = getenv("MALLOC_ARENAS");
+   if (getenv("MALLOC_GROW_STEP") == NULL || arenas == NULL || strcmp(arenas, "1") != 0)
+   {
+      setenv("MALLOC_GROW_STEP", "1048576", 1);
+      setenv("MALLOC_ARENAS", "1", 1);
+      setenv("MALLOC_PAGES", "sbrk", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   /* Under glibc there is no extended query, and the checks that need it
+      are skipped */
+   void (*stats_get)(struct malloc_stats_info *) = dlsym(RTLD_DEFAULT, "malloc_stats_get");
+   struct malloc_stats_info before, after;
+   int breaks = 0;
+
+   if (stats_get)
+   {
+      stats_get(&before);
+   }
+
+   char *brk = sbrk(0);
+   for (int i = 0; i < COUNT; i++)
+   {
+      ptrs[i] = malloc(SIZE);
+      assert(ptrs[i]);
+      ptrs[i][0] = ptrs[i][SIZE - 1] = (char)i;
+
+      if ((char *)sbrk(0) != brk)
+      {
+         brk = sbrk(0);
+         breaks++;
+      }
+   }
+
+   /* Requests that miss the free lists come out of the top back to back */
+   for (int i = 3; i < COUNT; i++)
+   {
+      assert(ptrs[i] - ptrs[i - 1] == ptrs[2] - ptrs[1]);
+   }
+   char *peak = sbrk(0);
+
+   if (stats_get)
+   {
+      /* About four steps' worth: the steps double, so the break moved
+         three times and the rest was carved from the wilderness */
+      stats_get(&after);
+      assert(breaks <= 3);
+      assert(after.grows - before.grows <= 3);
+      assert(after.carves - before.carves >= COUNT - 3);
+      assert(after.max_heap - before.max_heap >= (uint64_t)COUNT * SIZE);
+   }
+
+   /* Freeing from the top down hands back all but one step */
+   for (int i = COUNT - 1; i >= 0; i--)
+   {
+      assert(ptrs[i][0] == (char)i && ptrs[i][SIZE - 1] == (char)i);
+      free(ptrs[i]);
+   }
+   if (stats_get)
+   {
+      assert((char *)sbrk(0) < peak);
+      assert((char *)sbrk(0) >= ptrs[0] + GROW_STEP - SIZE);
+   }
+
+   printf("top test PASSED\n");
+
+   return 0;
+}
@@ -0,0 +1,93 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/malloc_trace.h"
+
+/* Finds the last event of op for ptr */
+static struct malloc_trace_event *find(struct malloc_trace_event *events, uint64_t count,
+                                       uint32_t op, uintptr_t ptr)
+{
+   for (uint64_t i = count; i-- > 0; )
+   {
+      if (events[i].op == op && events[i].ptr == ptr)
+      {
+         return &events[i];
+      }
+   }
+   return NULL;
+}
+
+int main(int argc, char **argv)
+{
+   char path[64];
+
+   /* The allocator reads the switch once, so come back with it set.  The
+      process id stays the same across exec. */
+   if (getenv("MALLOC_TRACE") == NULL)
+   {
+      setenv("MALLOC_TRACE", "/tmp/malloc-trace-test.%p", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+   snprintf(path, sizeof(path), "/tmp/malloc-trace-test.%d", (int)getpid());
+
+   char *a = malloc(100);
+   uintptr_t pa = (uintptr_t)a;
+   char *b = calloc(10, 30);
+   char *c = realloc(a, 5000);
+   void *d = NULL;
+   assert(posix_memalign(&d, 4096, 10) == 0);
+   assert(b && c && d);
+
+   /* Keep the addresses to look for once the memory is gone */
+   uintptr_t pb = (uintptr_t)b, pc = (uintptr_t)c, pd = (uintptr_t)d;
+   free(b);
+   free(c);
+   free(d);
+
+   /* Under glibc nothing writes a trace */
+   if (dlsym(RTLD_DEFAULT, "malloc_stats_get") == NULL)
+   {
+      printf("trace test SKIPPED: no traces without the library\n");
+      return 0;
+   }
+
+   FILE *f = fopen(path, "r");
+   assert(f);
+
+   struct malloc_trace_header header;
+   assert(fread(&header, sizeof(header), 1, f) == 1);
+   assert(header.magic == MALLOC_TRACE_MAGIC);
+   assert(header.count >= 7 && header.count <= header.capacity);
+
+   struct malloc_trace_event *events = calloc(header.count, sizeof(*events));
+   assert(fread(events, sizeof(*events), header.count, f) == header.count);
+   fclose(f);
+   unlink(path);
+
+   struct malloc_trace_event *e = find(events, header.count, MALLOC_TRACE_REALLOC, pc);
+   assert(e && e->arg == pa && e->size == 5000);
+   struct malloc_trace_event *m = find(events, e - events, MALLOC_TRACE_MALLOC, pa);
+   assert(m && m->size == 100 && m->thread == (uint32_t)gettid());
+   assert(m->time <= e->time);
+
+   e = find(events, header.count, MALLOC_TRACE_CALLOC, pb);
+   assert(e && e->size == 300);
+   e = find(events, header.count, MALLOC_TRACE_MEMALIGN, pd);
+   assert(e && e->arg == 4096 && e->size == 10);
+
+   assert(find(events, header.count, MALLOC_TRACE_FREE, pb));
+   assert(find(events, header.count, MALLOC_TRACE_FREE, pc));
+   assert(find(events, header.count, MALLOC_TRACE_FREE, pd));
+
+   printf("trace test PASSED\n");
+
+   return 0;
+}
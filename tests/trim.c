@@ -0,0 +1,62 @@
+#include <assert.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NUM_BUFFERS 64
+#define BUFFER_SIZE (16 * 1024)
+
+int main(int argc, char **argv)
+{
+   char *buffers[NUM_BUFFERS];
+
+   /* With one arena every request comes from the sbrk heap, whatever CPU
+      the thread runs on */
+   const char *arenas = getenv("MALLOC_ARENAS");
+   if (arenas == NULL || strcmp(arenas, "1") != 0)
+   {
+      setenv("MALLOC_ARENAS", "1", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   /* Keep everything in the heap so the spike moves the break */
+   assert(mallopt(M_MMAP_THRESHOLD, 1024 * 1024) == 1);
+   assert(mallopt(M_TRIM_THRESHOLD, 64 * 1024) == 1);
+
+   char *before = sbrk(0);
+
+   for (int i = 0; i < NUM_BUFFERS; i++)
+   {
+      buffers[i] = malloc(BUFFER_SIZE);
+      assert(buffers[i]);
+      memset(buffers[i], i, BUFFER_SIZE);
+   }
+
+   char *peak = sbrk(0);
+   assert(peak - before >= NUM_BUFFERS * BUFFER_SIZE);
+
+   /* Freeing the spike from the top down hands the memory back */
+   for (int i = NUM_BUFFERS - 1; i >= 0; i--)
+   {
+      free(buffers[i]);
+   }
+   assert((char *)sbrk(0) < peak);
+
+   /* malloc_trim drops the pages of a free _block below a live one */
+   char *hole = malloc(4 * BUFFER_SIZE);
+   char *live = malloc(4096);
+   assert(hole && live);
+   memset(hole, 'x', 4 * BUFFER_SIZE);
+   free(hole);
+   assert(malloc_trim(0) == 1);
+
+   free(live);
+
+   printf("trim test PASSED\n");
+
+   return 0;
+}
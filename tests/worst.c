@@ -0,0 +1,57 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int main(int argc, char **argv)
+{
+   /* The allocator reads the policy once, so come back with it set.  One
+      arena without slabs keeps every block in the same free lists. */
+   if (getenv("MALLOC_POLICY") == NULL)
+   {
+      setenv("MALLOC_POLICY", "worst", 1);
+      setenv("MALLOC_ARENAS", "1", 1);
+      setenv("MALLOC_SLABS", "0", 1);
+      execv("/proc/self/exe", argv);
+      perror("execv");
+      return 1;
+   }
+
+   /* Under glibc there is no worst fit to test */
+   if (dlsym(RTLD_DEFAULT, "malloc_stats_get") == NULL)
+   {
+      printf("worst test SKIPPED: no policies without the library\n");
+      return 0;
+   }
+
+   /* Reusing most of two freed blocks leaves two free blocks of the same
+      small size.  Worst fit takes the larger, higher one first, so its
+      leftover heads the class list. */
+   char *a1 = malloc(1200);
+   char *g1 = malloc(1200);
+   char *a2 = malloc(1296);
+   char *g2 = malloc(1200);
+   assert(a1 && g1 && a2 && g2);
+   free(a1);
+   free(a2);
+   char *b2 = malloc(1096);
+   char *b1 = malloc(1000);
+   assert(b1 == a1 && b2 == a2);
+
+   /* An aligned request skips the thread cache, and the tie goes to the
+      lower address */
+   char *p = aligned_alloc(32, 64);
+   assert(p > b1 && p < g1);
+
+   free(p);
+   free(b1);
+   free(b2);
+   free(g1);
+   free(g2);
+
+   printf("worst test PASSED\n");
+
+   return 0;
+}
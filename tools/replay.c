@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/malloc_trace.h"
+
+/*
+ * Replays an allocation trace written with MALLOC_TRACE against whatever
+ * malloc the process has:
+ *
+ *    tools/replay [-l lib/libmalloc-bf.so | -l glibc] trace
+ *
+ * -l reruns the tool with the library preloaded, or with none for glibc.
+ * Events are replayed in the order they were logged, on one thread.  The
+ * footprint is sampled through mallinfo2() every SAMPLE events, outside
+ * the timed part, to find the peak heap and the fragmentation at the
+ * peak: the share of the heap that was not live data.
+ */
+#define SAMPLE 1024
+
+struct entry
+{
+   uint64_t id;     /* Pointer in the trace, 0 for an empty slot */
+   void    *ptr;    /* Pointer in this run                       */
+   size_t   size;
+};
+
+static struct entry *table;
+static uint64_t      mask;
+
+static uint64_t now(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct entry *slot(uint64_t id)
+{
+   uint64_t i = (id >> 4) * 0x9E3779B97F4A7C15ULL >> 20 & mask;
+   while (table[i].id != 0 && table[i].id != id)
+   {
+      i = (i + 1) & mask;
+   }
+   return &table[i];
+}
+
+/* Linear probing without tombstones: shift later entries of the run back */
+static void removeEntry(struct entry *e)
+{
+   uint64_t i = e - table;
+   uint64_t j = i;
+
+   for (;;)
+   {
+      j = (j + 1) & mask;
+      if (table[j].id == 0)
+      {
+         break;
+      }
+      uint64_t home = (table[j].id >> 4) * 0x9E3779B97F4A7C15ULL >> 20 & mask;
+      if (((j - home) & mask) >= ((j - i) & mask))
+      {
+         table[i] = table[j];
+         i = j;
+      }
+   }
+   table[i].id = 0;
+}
+
+int main(int argc, char **argv)
+{
+   const char *lib = NULL;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "l:")) != -1)
+   {
+      if (opt == 'l')
+      {
+         lib = optarg;
+      }
+      else
+      {
+         optind = argc + 1;
+      }
+   }
+   if (optind != argc - 1)
+   {
+      fprintf(stderr, "usage: %s [-l library | -l glibc] trace\n", argv[0]);
+      return 2;
+   }
+
+   /* Never trace the replay over the trace */
+   if (getenv("MALLOC_TRACE"))
+   {
+      unsetenv("MALLOC_TRACE");
+      execv("/proc/self/exe", argv);
+   }
+
+   if (lib)
+   {
+      const char *preload = getenv("LD_PRELOAD");
+      char path[4096];
+
+      if (strcmp(lib, "glibc") == 0)
+      {
+         if (preload)
+         {
+            unsetenv("LD_PRELOAD");
+            execv("/proc/self/exe", argv);
+         }
+      }
+      else if (realpath(lib, path) == NULL)
+      {
+         perror(lib);
+         return 1;
+      }
+      else if (!preload || strcmp(preload, path) != 0)
+      {
+         setenv("LD_PRELOAD", path, 1);
+         execv("/proc/self/exe", argv);
+      }
+   }
+
+   int fd = open(argv[optind], O_RDONLY);
+   struct stat st;
+   if (fd < 0 || fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct malloc_trace_header))
+   {
+      perror(argv[optind]);
+      return 1;
+   }
+
+   struct malloc_trace_header *header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (header == MAP_FAILED || header->magic != MALLOC_TRACE_MAGIC ||
+       (uint64_t)st.st_size < sizeof(*header) + header->capacity * sizeof(struct malloc_trace_event))
+   {
+      fprintf(stderr, "%s: not a trace\n", argv[optind]);
+      return 1;
+   }
+
+   struct malloc_trace_event *events = (struct malloc_trace_event *)(header + 1);
+   uint64_t capacity = header->capacity;
+   uint64_t count = header->count < capacity ? header->count : capacity;
+   uint64_t first = header->count < capacity ? 0 : header->count % capacity;
+
+   /* Keep the table out of the heap being measured */
+   uint64_t slots = 1024;
+   while (slots < 2 * count)
+   {
+      slots *= 2;
+   }
+   mask = slots - 1;
+   table = mmap(NULL, slots * sizeof(struct entry), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (table == MAP_FAILED)
+   {
+      perror("mmap");
+      return 1;
+   }
+
+   uint64_t elapsed = 0;
+   uint64_t live = 0;
+   uint64_t peak_live = 0;
+   uint64_t peak_heap = 0;
+   uint64_t live_at_peak = 0;
+   uint64_t unmatched = 0;
+
+   for (uint64_t done = 0; done < count; )
+   {
+      uint64_t stop = done + SAMPLE < count ? done + SAMPLE : count;
+      uint64_t start = now();
+
+      for (; done < stop; done++)
+      {
+         struct malloc_trace_event *e = &events[(first + done) % capacity];
+         struct entry *old = NULL;
+         void *ptr = NULL;
+
+         if (e->op == MALLOC_TRACE_FREE || e->op == MALLOC_TRACE_REALLOC)
+         {
+            old = slot(e->op == MALLOC_TRACE_FREE ? e->ptr : e->arg);
+            if (old->id == 0)
+            {
+               /* Allocated before the ring wrapped */
+               unmatched += e->op == MALLOC_TRACE_FREE || e->arg != 0;
+               old = NULL;
+            }
+         }
+
+         switch (e->op)
+         {
+         case MALLOC_TRACE_MALLOC:
+            ptr = e->ptr ? malloc(e->size) : NULL;
+            break;
+         case MALLOC_TRACE_CALLOC:
+            ptr = e->ptr ? calloc(1, e->size) : NULL;
+            break;
+         case MALLOC_TRACE_MEMALIGN:
+            if (e->ptr && posix_memalign(&ptr, e->arg < sizeof(void *) ? sizeof(void *) : e->arg,
+                                         e->size) != 0)
+            {
+               ptr = NULL;
+            }
+            break;
+         case MALLOC_TRACE_FREE:
+            if (old)
+            {
+               free(old->ptr);
+            }
+            break;
+         case MALLOC_TRACE_REALLOC:
+            if (e->ptr == 0)
+            {
+               /* Shrunk to nothing, or failed and left as it was */
+               if (old && e->size == 0)
+               {
+                  free(old->ptr);
+               }
+               else
+               {
+                  old = NULL;
+               }
+            }
+            else
+            {
+               ptr = realloc(old ? old->ptr : NULL, e->size);
+            }
+            break;
+         }
+
+         if (old)
+         {
+            live -= old->size;
+            removeEntry(old);
+         }
+         if (ptr)
+         {
+            struct entry *n = slot(e->ptr);
+            if (n->id != 0)
+            {
+               /* Freed where the trace could not see it */
+               live -= n->size;
+               free(n->ptr);
+            }
+            n->id = e->ptr;
+            n->ptr = ptr;
+            n->size = e->size;
+            live += e->size;
+         }
+      }
+
+      elapsed += now() - start;
+
+      if (live > peak_live)
+      {
+         peak_live = live;
+      }
+      struct mallinfo2 mi = mallinfo2();
+      uint64_t heap = mi.arena + mi.hblkhd;
+      if (heap > peak_heap)
+      {
+         peak_heap = heap;
+         live_at_peak = live;
+      }
+   }
+
+   const char *name = getenv("LD_PRELOAD");
+   printf("Allocator:\t%s\n", name && *name ? name : "glibc");
+   printf("Events:\t\t%" PRIu64 " (%" PRIu64 " lost to the ring, %" PRIu64 " unmatched frees)\n",
+          count, header->count - count, unmatched);
+   printf("Time:\t\t%.3f ms (%.1f ns/event)\n", elapsed / 1e6,
+          count ? (double)elapsed / count : 0.0);
+   printf("Peak live:\t%" PRIu64 " bytes\n", peak_live);
+   printf("Peak heap:\t%" PRIu64 " bytes\n", peak_heap);
+   printf("Fragmentation:\t%.1f%% of the heap at its peak\n",
+          peak_heap ? 100.0 * (peak_heap - live_at_peak) / peak_heap : 0.0);
+
+   return 0;
+}